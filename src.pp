@@ -0,0 +1,862 @@
+typedef unsigned char __u_char;
+typedef unsigned short int __u_short;
+typedef unsigned int __u_int;
+typedef unsigned long int __u_long;
+typedef signed char __int8_t;
+typedef unsigned char __uint8_t;
+typedef signed short int __int16_t;
+typedef unsigned short int __uint16_t;
+typedef signed int __int32_t;
+typedef unsigned int __uint32_t;
+typedef signed long int __int64_t;
+typedef unsigned long int __uint64_t;
+typedef __int8_t __int_least8_t;
+typedef __uint8_t __uint_least8_t;
+typedef __int16_t __int_least16_t;
+typedef __uint16_t __uint_least16_t;
+typedef __int32_t __int_least32_t;
+typedef __uint32_t __uint_least32_t;
+typedef __int64_t __int_least64_t;
+typedef __uint64_t __uint_least64_t;
+typedef long int __quad_t;
+typedef unsigned long int __u_quad_t;
+typedef long int __intmax_t;
+typedef unsigned long int __uintmax_t;
+typedef unsigned long int __dev_t;
+typedef unsigned int __uid_t;
+typedef unsigned int __gid_t;
+typedef unsigned long int __ino_t;
+typedef unsigned long int __ino64_t;
+typedef unsigned int __mode_t;
+typedef unsigned long int __nlink_t;
+typedef long int __off_t;
+typedef long int __off64_t;
+typedef int __pid_t;
+typedef struct {
+int __val[2];
+}
+__fsid_t;
+typedef long int __clock_t;
+typedef unsigned long int __rlim_t;
+typedef unsigned long int __rlim64_t;
+typedef unsigned int __id_t;
+typedef long int __time_t;
+typedef unsigned int __useconds_t;
+typedef long int __suseconds_t;
+typedef long int __suseconds64_t;
+typedef int __daddr_t;
+typedef int __key_t;
+typedef int __clockid_t;
+typedef void * __timer_t;
+typedef long int __blksize_t;
+typedef long int __blkcnt_t;
+typedef long int __blkcnt64_t;
+typedef unsigned long int __fsblkcnt_t;
+typedef unsigned long int __fsblkcnt64_t;
+typedef unsigned long int __fsfilcnt_t;
+typedef unsigned long int __fsfilcnt64_t;
+typedef long int __fsword_t;
+typedef long int __ssize_t;
+typedef long int __syscall_slong_t;
+typedef unsigned long int __syscall_ulong_t;
+typedef __off64_t __loff_t;
+typedef char *__caddr_t;
+typedef long int __intptr_t;
+typedef unsigned int __socklen_t;
+typedef int __sig_atomic_t;
+typedef __int8_t int8_t;
+typedef __int16_t int16_t;
+typedef __int32_t int32_t;
+typedef __int64_t int64_t;
+typedef __uint8_t uint8_t;
+typedef __uint16_t uint16_t;
+typedef __uint32_t uint32_t;
+typedef __uint64_t uint64_t;
+typedef __int_least8_t int_least8_t;
+typedef __int_least16_t int_least16_t;
+typedef __int_least32_t int_least32_t;
+typedef __int_least64_t int_least64_t;
+typedef __uint_least8_t uint_least8_t;
+typedef __uint_least16_t uint_least16_t;
+typedef __uint_least32_t uint_least32_t;
+typedef __uint_least64_t uint_least64_t;
+typedef signed char int_fast8_t;
+typedef long int int_fast16_t;
+typedef long int int_fast32_t;
+typedef long int int_fast64_t;
+typedef unsigned char uint_fast8_t;
+typedef unsigned long int uint_fast16_t;
+typedef unsigned long int uint_fast32_t;
+typedef unsigned long int uint_fast64_t;
+typedef long int intptr_t;
+typedef unsigned long int uintptr_t;
+typedef __intmax_t intmax_t;
+typedef __uintmax_t uintmax_t;
+extern volatile uint8_t PIND;
+extern volatile uint8_t DDRD;
+extern volatile uint8_t PORTD;
+extern volatile uint8_t PINB;
+extern volatile uint8_t DDRB;
+extern volatile uint8_t PORTB;
+extern volatile uint8_t PINC;
+extern volatile uint8_t DDRC;
+extern volatile uint8_t PORTC;
+extern volatile uint8_t TCCR0A;
+extern volatile uint8_t TCCR0B;
+extern volatile uint8_t TCNT0;
+extern volatile uint8_t OCR0A;
+extern volatile uint8_t OCR0B;
+extern volatile uint8_t TIMSK0;
+extern volatile uint8_t TIFR0;
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint8_t TCCR1C;
+extern volatile uint16_t TCNT1;
+extern volatile uint8_t TCNT1H;
+extern volatile uint8_t TCNT1L;
+extern volatile uint16_t OCR1A;
+extern volatile uint8_t OCR1AH;
+extern volatile uint8_t OCR1AL;
+extern volatile uint16_t OCR1B;
+extern volatile uint16_t ICR1;
+extern volatile uint8_t TIMSK1;
+extern volatile uint8_t TIFR1;
+extern volatile uint8_t TCCR2A;
+extern volatile uint8_t TCCR2B;
+extern volatile uint8_t TCNT2;
+extern volatile uint8_t OCR2A;
+extern volatile uint8_t OCR2B;
+extern volatile uint8_t TIMSK2;
+extern volatile uint8_t TIFR2;
+extern volatile uint8_t ASSR;
+extern volatile uint8_t EICRA;
+extern volatile uint8_t EIMSK;
+extern volatile uint8_t EIFR;
+extern volatile uint8_t PCICR;
+extern volatile uint8_t PCIFR;
+extern volatile uint8_t PCMSK0;
+extern volatile uint8_t PCMSK1;
+extern volatile uint8_t PCMSK2;
+extern volatile uint8_t SPCR;
+extern volatile uint8_t SPSR;
+extern volatile uint8_t SPDR;
+extern volatile uint8_t CLKPR;
+extern volatile uint8_t GTCCR;
+extern volatile uint8_t MCUSR;
+extern volatile uint8_t MCUCR;
+extern volatile uint8_t SMCR;
+extern volatile uint8_t PRR;
+extern volatile uint8_t WDTCSR;
+extern volatile uint8_t GPIOR0;
+extern volatile uint8_t GPIOR1;
+extern volatile uint8_t GPIOR2;
+extern volatile uint8_t ACSR;
+extern volatile uint8_t ADCSRA;
+extern volatile uint8_t ADCSRB;
+extern volatile uint8_t ADMUX;
+extern volatile uint8_t ADCL;
+extern volatile uint8_t ADCH;
+extern volatile uint16_t ADC;
+extern volatile uint8_t DIDR1;
+extern volatile uint8_t DIDR0;
+extern volatile uint8_t TWBR;
+extern volatile uint8_t TWSR;
+extern volatile uint8_t TWAR;
+extern volatile uint8_t TWDR;
+extern volatile uint8_t TWCR;
+extern volatile uint8_t TWAMR;
+extern volatile uint8_t EECR;
+extern volatile uint8_t EEDR;
+extern volatile uint16_t EEAR;
+extern volatile uint8_t SREG;
+extern volatile uint8_t SPH;
+extern volatile uint8_t SPL;
+extern volatile uint16_t SP;
+enum ir_state_t {
+IR_BURST, IR_GAP, IR_ADDRESS, IR_ADDRESS_INV, IR_COMMAND, IR_COMMAND_INV };
+typedef uint8_t ir_addr_t;
+enum ir_capture_reason_t {
+IR_CAP_OK, IR_CAP_HOLD, IR_CAP_WINDOW, IR_CAP_CHECK, IR_CAP_FILTER, IR_CAP_TIMEOUT };
+struct ir_capture {
+uint8_t reason;
+uint8_t state;
+uint8_t count;
+uint8_t edges_cnt;
+uint8_t edges[68];
+};
+struct ir_stats_struct {
+uint16_t frames;
+uint16_t repeats;
+uint16_t dropped;
+uint16_t timeouts;
+uint16_t filtered;
+uint16_t resets[6];
+};
+struct ir_struct {
+uint8_t address;
+uint8_t command;
+uint8_t status;
+};
+volatile struct ir_struct ir;
+void ir_init( void );
+void ir_stop( void );
+void ir_setAddressFilter( const ir_addr_t *addresses, uint8_t count );
+void ir_statsGet( struct ir_stats_struct *stats, uint8_t clear );
+typedef int __gwchar_t;
+typedef struct {
+long int quot;
+long int rem;
+}
+imaxdiv_t;
+extern intmax_t imaxabs (intmax_t __n) __attribute__ ((__nothrow__ , __leaf__)) __attribute__ ((__const__));
+extern imaxdiv_t imaxdiv (intmax_t __numer, intmax_t __denom) __attribute__ ((__nothrow__ , __leaf__)) __attribute__ ((__const__));
+extern intmax_t strtoimax (const char *__restrict __nptr, char **__restrict __endptr, int __base) __attribute__ ((__nothrow__ , __leaf__));
+extern uintmax_t strtoumax (const char *__restrict __nptr, char ** __restrict __endptr, int __base) __attribute__ ((__nothrow__ , __leaf__));
+extern intmax_t wcstoimax (const __gwchar_t *__restrict __nptr, __gwchar_t **__restrict __endptr, int __base) __attribute__ ((__nothrow__ , __leaf__));
+extern uintmax_t wcstoumax (const __gwchar_t *__restrict __nptr, __gwchar_t ** __restrict __endptr, int __base) __attribute__ ((__nothrow__ , __leaf__));
+struct clock_snapshot {
+int8_t digits[4];
+uint8_t seconds;
+uint8_t weekday;
+};
+struct alarm_struct {
+int8_t digits[4];
+uint8_t days;
+};
+struct resume_struct {
+uint16_t magic;
+int8_t clockDigits[4];
+uint32_t minuteTicks;
+uint8_t weekday;
+struct alarm_struct alarms[2];
+uint8_t checksum;
+};
+struct powerfail_struct {
+uint8_t magic;
+uint16_t clock;
+uint8_t weekday;
+uint16_t alarmTimes[2];
+uint8_t alarmDays[2];
+uint8_t checksum;
+};
+void timer1_init(void);
+void clock_start(uint8_t restart);
+uint32_t timer1_now(void);
+void clock_minuteTick(void);
+void user_mode(uint8_t command);
+void user_idle(void);
+void display_resume(void);
+void clock_set(const volatile int8_t *digits, uint8_t weekday);
+void timeEntry_start(uint8_t commit);
+void timeEntry_poll(void);
+void clockControl_incDigit(void);
+void clockControl_decDigit(void);
+void clockControl_incDigitNum(void);
+void clockControl_decDigitNum(void);
+uint8_t time_enterDigit(volatile int8_t *digits, volatile uint8_t *ptr, uint8_t value);
+void clockUpdateDisplay(void);
+void clock_getSnapshot(struct clock_snapshot *snap);
+void user_setAlarm(void);
+uint8_t user_setAlarmDays(uint8_t days);
+uint8_t user_pickValue(uint8_t symbol, uint8_t value, uint8_t min, uint8_t max);
+void alarm_schedule(uint8_t inclusive);
+void user_stopwatch(uint8_t countdown);
+void stopwatchUpdateDisplay(uint32_t ticks);
+void stopwatch_refresh(void);
+void alarmControl_incDigit(void);
+void alarmControl_decDigit(void);
+void alarmControl_incDigitNum(void);
+void alarmControl_decDigitNum(void);
+void alarmBuzzer_activate(void);
+void alarmBuzzer_off(void);
+void remote_loadFilter(void);
+void user_learnRemote(void);
+void user_learnKeys(void);
+void user_ramStats(void);
+void user_irDump(void);
+void resume_save(void);
+uint8_t resume_restore(void);
+void powerfail_init(void);
+void powerfail_arm(void);
+uint8_t eeprom_lock(void);
+void eeprom_unlock(uint8_t lock);
+void eeprom_store(void *dst, const void *src, uint8_t size);
+void powerfail_restore(void);
+uint16_t powerfail_maxMs(void);
+void user_irLoopback(void);
+void loopback_step(void);
+struct ds3231_time;
+void rtc_sync(uint8_t status, const struct ds3231_time *time);
+uint8_t rtc_load(void);
+void rtc_store(void);
+void MAX7219_init(void);
+void MAX7219_intensity(uint8_t intensityValue);
+void MAX7219_displayTest(uint8_t displayTest);
+void MAX7219_scanLimit(uint8_t scanLimit);
+void MAX7219_decodeMode(uint8_t decodeMode);
+void MAX7219_shutdown(uint8_t shutdownFlag);
+void MAX7219_shutdownISR(uint8_t shutdownFlag);
+void MAX7219_setDigitNum(uint8_t digit, uint8_t number);
+void display_init(uint8_t digits);
+void display_setNumber(int32_t number, uint8_t firstDigit, uint8_t width, uint8_t dpDigit, uint8_t flags);
+void display_blank(uint8_t firstDigit, uint8_t width);
+uint8_t display_segments(uint8_t code);
+void clkgov_init(void);
+void clkgov_request(uint16_t source);
+void clkgov_release(uint16_t source);
+struct ramstat {
+uint16_t staticSize;
+uint16_t stackPeak;
+uint16_t headroom;
+uint8_t isrNestMax;
+};
+void ramstat_get(struct ramstat *stat);
+_Static_assert( ( ( (uint32_t)((9000) + (uint32_t)(9000) * (10 + 15) / 100 + 150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ) + 1 ) <= 255, "AGC burst does not fit Timer 0, lower IR_TIMER_PRESCALER" );
+_Static_assert( ( (uint32_t)((560) - (uint32_t)(560) * (10) / 100 - 150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ) + 1 < ( ( (uint32_t)((560) + (uint32_t)(560) * (10) / 100 + 150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ) + 1 ), "Bit pulse window empty, raise F_CPU or lower IR_TIMER_PRESCALER" );
+_Static_assert( ( (uint32_t)((560) - (uint32_t)(560) * (10) / 100 - 150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ) + 1 < ( ( (uint32_t)((560) + (uint32_t)(560) * (10) / 100 + 150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ) + 1 ), "Zero window empty, raise F_CPU or lower IR_TIMER_PRESCALER" );
+_Static_assert( ( ( (uint32_t)((560) + (uint32_t)(560) * (10) / 100 + 150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ) + 1 ) <= ( (uint32_t)((1690) - (uint32_t)(1690) * (10) / 100 - 150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ) + 1, "Zero and one windows overlap, lower IR_TOLERANCE_PCT" );
+_Static_assert( ( ( (uint32_t)((2250) + (uint32_t)(2250) * (10) / 100 + 150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ) + 1 ) <= ( (uint32_t)((4500) - (uint32_t)(4500) * (10) / 100 - 150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ) + 1, "Hold and gap windows overlap, lower IR_TOLERANCE_PCT" );
+_Static_assert( ( ( (uint32_t)((4500) + (uint32_t)(4500) * (10) / 100 + 150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ) + 1 ) <= ( (uint32_t)((9000) - (uint32_t)(9000) * (10 + 15) / 100 - 150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ) + 1, "Gap and burst windows overlap, lower IR_TOLERANCE_PCT" );
+_Static_assert( ( (82000UL + ( 256UL * 1024 * 1000UL / (16000000UL / 1000UL) ) / 2) / ( 256UL * 1024 * 1000UL / (16000000UL / 1000UL) ) ) >= 1 && ( (82000UL + ( 256UL * 1024 * 1000UL / (16000000UL / 1000UL) ) / 2) / ( 256UL * 1024 * 1000UL / (16000000UL / 1000UL) ) ) <= 255, "Key hold timeout out of range" );
+_Static_assert( ( ( (uint32_t)((4500) + (uint32_t)(4500) * (10 + 15) / 100 + 150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ) + 1 ) <= ( (uint32_t)((9000) - (uint32_t)(9000) * (10 + 15) / 100 - 150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ) + 1, "Gap and burst windows overlap, lower IR_CAL_RANGE_PCT" );
+struct ir_rx {
+uint8_t state;
+uint8_t bitctr;
+uint8_t address;
+uint8_t command;
+uint8_t keyhold;
+uint8_t ovf;
+struct {
+uint8_t gap_min, gap_max;
+uint8_t hold_min, hold_max;
+uint8_t pulse_min, pulse_max;
+uint8_t zero_min, zero_max;
+uint8_t one_min, one_max;
+}
+win;
+int8_t cal_offset[4];
+uint8_t cal_slot;
+uint8_t cal_burst;
+uint16_t mark_sum;
+};
+static struct ir_rx ir_rx0;
+static ir_addr_t ir_filter[4];
+static uint8_t ir_filter_cnt;
+static inline __attribute__((always_inline)) uint8_t ir_addr_accept( struct ir_rx *rx, ir_addr_t address ) {
+uint8_t i;
+if(ir_filter_cnt==0) {
+rx->cal_slot = 0;
+return 1;
+}
+for(i=0;i<ir_filter_cnt;i++) {
+if(ir_filter[i]==address) {
+rx->cal_slot = i;
+return 1;
+}
+}
+return 0;
+}
+static void ir_window( uint16_t nominal, uint8_t *min, uint8_t *max ) {
+uint16_t delta = (nominal>>8) * ( (10 * 256 + 50) / 100 );
+int16_t lo = (int16_t)((nominal - delta)>>8) - ( (uint8_t)( (uint32_t)(150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ) );
+uint16_t hi = ((nominal + delta)>>8) + ( (uint8_t)( (uint32_t)(150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ) ) + 1;
+*min = lo<0 ? 0 : lo;
+*max = hi>255 ? 255 : hi;
+}
+static inline __attribute__((always_inline)) void ir_calibrate( struct ir_rx *rx, uint8_t burst ) {
+int16_t offset = (int16_t)rx->cal_offset[rx->cal_slot] << 4;
+rx->cal_burst = burst;
+rx->mark_sum = 0;
+ir_window( (uint16_t)burst * 128, &rx->win.gap_min, &rx->win.gap_max );
+ir_window( (uint16_t)burst * 64, &rx->win.hold_min, &rx->win.hold_max );
+ir_window( (uint16_t)burst * 16 + offset, &rx->win.pulse_min, &rx->win.pulse_max );
+ir_window( (uint16_t)burst * 16 - offset, &rx->win.zero_min, &rx->win.zero_max );
+ir_window( (uint16_t)burst * 48 - offset, &rx->win.one_min, &rx->win.one_max );
+}
+static inline __attribute__((always_inline)) void ir_cal_learn( struct ir_rx *rx ) {
+int16_t error = (int16_t)(rx->mark_sum>>1) - (int16_t)(((uint16_t)rx->cal_burst * 16)>>4);
+int16_t offset = rx->cal_offset[rx->cal_slot];
+offset += (error - offset) / 4;
+if(offset>( 2 * 16 )) offset = ( 2 * 16 );
+if(offset<-( 2 * 16 )) offset = -( 2 * 16 );
+rx->cal_offset[rx->cal_slot] = offset;
+}
+static void ir_rx_reset( struct ir_rx *rx ) {
+rx->state = IR_BURST;
+rx->keyhold = 0;
+rx->ovf = 1;
+}
+static struct ir_stats_struct ir_stats;
+_Static_assert( sizeof(ir_stats.resets) / sizeof(ir_stats.resets[0]) == IR_COMMAND_INV + 1, "One reset counter per state" );
+static inline __attribute__((always_inline)) void ir_deliver( struct ir_rx *rx ) {
+if(!(ir.status & (1<<0))) {
+ir.address = rx->address;
+ir.command = rx->command;
+ir.status |= (1<<0) | (1<<2);
+rx->keyhold = ( (82000UL + ( 256UL * 1024 * 1000UL / (16000000UL / 1000UL) ) / 2) / ( 256UL * 1024 * 1000UL / (16000000UL / 1000UL) ) );
+do {
+if(ir_stats.frames!=0xFFFF) ir_stats.frames++;
+}
+while(0);
+}
+else do {
+if(ir_stats.dropped!=0xFFFF) ir_stats.dropped++;
+}
+while(0);
+}
+void ir_init( void ) {
+TCCR0A = 0;
+( TCCR0B &= ~((1<<0) | (1<<1) | (1<<2)) );
+TIMSK0 |= (1<<0);
+DDRD &= ~(1<<2);
+EICRA |= (1<<0);
+EIMSK |= (1<<0);
+ir_rx_reset(&ir_rx0);
+__asm__ __volatile__("");
+}
+void ir_stop( void ) {
+( TCCR0B &= ~((1<<0) | (1<<1) | (1<<2)) );
+TIMSK0 &= ~(1<<0);
+EIMSK &= ~(1<<0);
+}
+void ir_setAddressFilter( const ir_addr_t *addresses, uint8_t count ) {
+uint8_t i;
+uint8_t sreg = SREG;
+if(count>4) count = 4;
+__asm__ __volatile__("");
+for(i=0;i<count;i++) ir_filter[i] = addresses[i];
+for(i=0;i<4;i++) ir_rx0.cal_offset[i] = 0;
+ir_rx0.cal_slot = 0;
+ir_filter_cnt = count;
+SREG = sreg;
+}
+void ir_statsGet( struct ir_stats_struct *stats, uint8_t clear ) {
+uint8_t i;
+uint8_t sreg = SREG;
+__asm__ __volatile__("");
+*stats = ir_stats;
+if(clear) {
+for(i=0;i<sizeof(ir_stats);i++) ((uint8_t *)&ir_stats)[i] = 0;
+}
+SREG = sreg;
+}
+void INT0_vect(void) ;
+void INT0_vect(void) {
+do {
+if (++GPIOR1 > GPIOR2) GPIOR2 = GPIOR1;
+}
+while (0);
+uint8_t port_state = ( PIND & (1<<2) );
+uint8_t cnt_state = TCNT0;
+if(ir_rx0.ovf!=0) {
+((void)0);
+if(ir_rx0.state!=IR_BURST) do {
+if(ir_stats.timeouts!=0xFFFF) ir_stats.timeouts++;
+}
+while(0);
+ir_rx0.ovf = 0;
+ir_rx0.state = IR_BURST;
+clkgov_request(0x02);
+TCNT0 = 0;
+( TCCR0B |= ( (1<<0) | (1<<2) ) );
+if(!port_state) ((void)0);
+(GPIOR1--);
+return;
+}
+((void)0);
+switch(ir_rx0.state) {
+case IR_BURST: if(!port_state) {
+TCNT0 = 0;
+((void)0);
+}
+else {
+if((cnt_state>( (uint32_t)((9000) - (uint32_t)(9000) * (10 + 15) / 100 - 150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ))&&(cnt_state<( ( (uint32_t)((9000) + (uint32_t)(9000) * (10 + 15) / 100 + 150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ) + 1 ))) {
+ir_rx0.state = IR_GAP;
+TCNT0 = 0;
+ir_calibrate(&ir_rx0, cnt_state);
+}
+else if(cnt_state>=( ( (uint32_t)((560) + (uint32_t)(560) * (10) / 100 + 150) * (16000000UL / 1000UL) / ((uint32_t)1024 * 1000UL) ) + 1 )) {
+do {
+((void)0);
+if((IR_CAP_WINDOW)==IR_CAP_FILTER) do {
+if(ir_stats.filtered!=0xFFFF) ir_stats.filtered++;
+}
+while(0);
+else do {
+if(ir_stats.resets[ir_rx0.state]!=0xFFFF) ir_stats.resets[ir_rx0.state]++;
+}
+while(0);
+ir_rx0.state = IR_BURST;
+}
+while(0);
+}
+}
+break;
+case IR_GAP: if(!port_state) {
+if((cnt_state>ir_rx0.win.gap_min)&&(cnt_state<ir_rx0.win.gap_max)) {
+TCNT0 = 0;
+ir_rx0.state = IR_ADDRESS;
+ir_rx0.bitctr = 0;
+ir.status &= ~(1<<1);
+break;
+}
+else if((cnt_state>ir_rx0.win.hold_min)&&(cnt_state<ir_rx0.win.hold_max)) {
+if(ir.status & (1<<2)) {
+ir.status |= (1<<1);
+ir_rx0.keyhold = ( (82000UL + ( 256UL * 1024 * 1000UL / (16000000UL / 1000UL) ) / 2) / ( 256UL * 1024 * 1000UL / (16000000UL / 1000UL) ) );
+}
+((void)0);
+do {
+if(ir_stats.repeats!=0xFFFF) ir_stats.repeats++;
+}
+while(0);
+ir_rx0.state = IR_BURST;
+break;
+}
+}
+do {
+((void)0);
+if((IR_CAP_WINDOW)==IR_CAP_FILTER) do {
+if(ir_stats.filtered!=0xFFFF) ir_stats.filtered++;
+}
+while(0);
+else do {
+if(ir_stats.resets[ir_rx0.state]!=0xFFFF) ir_stats.resets[ir_rx0.state]++;
+}
+while(0);
+ir_rx0.state = IR_BURST;
+}
+while(0);
+break;
+case IR_ADDRESS: if(port_state) {
+if((cnt_state>ir_rx0.win.pulse_min)&&(cnt_state<ir_rx0.win.pulse_max)) {
+TCNT0 = 0;
+ir_rx0.mark_sum += cnt_state;
+break;
+}
+do {
+((void)0);
+if((IR_CAP_WINDOW)==IR_CAP_FILTER) do {
+if(ir_stats.filtered!=0xFFFF) ir_stats.filtered++;
+}
+while(0);
+else do {
+if(ir_stats.resets[ir_rx0.state]!=0xFFFF) ir_stats.resets[ir_rx0.state]++;
+}
+while(0);
+ir_rx0.state = IR_BURST;
+}
+while(0);
+}
+else {
+if((cnt_state>ir_rx0.win.zero_min)&&(cnt_state<ir_rx0.win.zero_max)) {
+ir_rx0.address &= ~(1<<ir_rx0.bitctr++);
+TCNT0 = 0;
+if(ir_rx0.bitctr>=8) {
+ir_rx0.state = IR_ADDRESS_INV;
+ir_rx0.bitctr = 0;
+if(!ir_addr_accept(&ir_rx0, ir_rx0.address)) do {
+((void)0);
+if((IR_CAP_FILTER)==IR_CAP_FILTER) do {
+if(ir_stats.filtered!=0xFFFF) ir_stats.filtered++;
+}
+while(0);
+else do {
+if(ir_stats.resets[ir_rx0.state]!=0xFFFF) ir_stats.resets[ir_rx0.state]++;
+}
+while(0);
+ir_rx0.state = IR_BURST;
+}
+while(0);
+}
+break;
+}
+else if((cnt_state>ir_rx0.win.one_min)&&(cnt_state<ir_rx0.win.one_max)) {
+ir_rx0.address |= (1<<ir_rx0.bitctr++);
+TCNT0 = 0;
+if(ir_rx0.bitctr>=8) {
+ir_rx0.state = IR_ADDRESS_INV;
+ir_rx0.bitctr = 0;
+if(!ir_addr_accept(&ir_rx0, ir_rx0.address)) do {
+((void)0);
+if((IR_CAP_FILTER)==IR_CAP_FILTER) do {
+if(ir_stats.filtered!=0xFFFF) ir_stats.filtered++;
+}
+while(0);
+else do {
+if(ir_stats.resets[ir_rx0.state]!=0xFFFF) ir_stats.resets[ir_rx0.state]++;
+}
+while(0);
+ir_rx0.state = IR_BURST;
+}
+while(0);
+}
+break;
+}
+do {
+((void)0);
+if((IR_CAP_WINDOW)==IR_CAP_FILTER) do {
+if(ir_stats.filtered!=0xFFFF) ir_stats.filtered++;
+}
+while(0);
+else do {
+if(ir_stats.resets[ir_rx0.state]!=0xFFFF) ir_stats.resets[ir_rx0.state]++;
+}
+while(0);
+ir_rx0.state = IR_BURST;
+}
+while(0);
+break;
+}
+break;
+case IR_ADDRESS_INV: if(port_state) {
+if((cnt_state>ir_rx0.win.pulse_min)&&(cnt_state<ir_rx0.win.pulse_max)) {
+TCNT0 = 0;
+ir_rx0.mark_sum += cnt_state;
+break;
+}
+do {
+((void)0);
+if((IR_CAP_WINDOW)==IR_CAP_FILTER) do {
+if(ir_stats.filtered!=0xFFFF) ir_stats.filtered++;
+}
+while(0);
+else do {
+if(ir_stats.resets[ir_rx0.state]!=0xFFFF) ir_stats.resets[ir_rx0.state]++;
+}
+while(0);
+ir_rx0.state = IR_BURST;
+}
+while(0);
+}
+else {
+if((cnt_state>ir_rx0.win.zero_min)&&(cnt_state<ir_rx0.win.zero_max)) {
+if(!(ir_rx0.address&(1<<ir_rx0.bitctr++))) {
+do {
+((void)0);
+if((IR_CAP_CHECK)==IR_CAP_FILTER) do {
+if(ir_stats.filtered!=0xFFFF) ir_stats.filtered++;
+}
+while(0);
+else do {
+if(ir_stats.resets[ir_rx0.state]!=0xFFFF) ir_stats.resets[ir_rx0.state]++;
+}
+while(0);
+ir_rx0.state = IR_BURST;
+}
+while(0);
+break;
+}
+TCNT0 = 0;
+if(ir_rx0.bitctr>=8) {
+ir_rx0.state = IR_COMMAND;
+ir_rx0.bitctr = 0;
+}
+break;
+}
+else if((cnt_state>ir_rx0.win.one_min)&&(cnt_state<ir_rx0.win.one_max)) {
+if(ir_rx0.address&(1<<ir_rx0.bitctr++)) {
+do {
+((void)0);
+if((IR_CAP_CHECK)==IR_CAP_FILTER) do {
+if(ir_stats.filtered!=0xFFFF) ir_stats.filtered++;
+}
+while(0);
+else do {
+if(ir_stats.resets[ir_rx0.state]!=0xFFFF) ir_stats.resets[ir_rx0.state]++;
+}
+while(0);
+ir_rx0.state = IR_BURST;
+}
+while(0);
+break;
+}
+TCNT0 = 0;
+if(ir_rx0.bitctr>=8) {
+ir_rx0.state = IR_COMMAND;
+ir_rx0.bitctr = 0;
+}
+break;
+}
+do {
+((void)0);
+if((IR_CAP_WINDOW)==IR_CAP_FILTER) do {
+if(ir_stats.filtered!=0xFFFF) ir_stats.filtered++;
+}
+while(0);
+else do {
+if(ir_stats.resets[ir_rx0.state]!=0xFFFF) ir_stats.resets[ir_rx0.state]++;
+}
+while(0);
+ir_rx0.state = IR_BURST;
+}
+while(0);
+break;
+}
+break;
+case IR_COMMAND: if(port_state) {
+if((cnt_state>ir_rx0.win.pulse_min)&&(cnt_state<ir_rx0.win.pulse_max)) {
+TCNT0 = 0;
+ir_rx0.mark_sum += cnt_state;
+break;
+}
+do {
+((void)0);
+if((IR_CAP_WINDOW)==IR_CAP_FILTER) do {
+if(ir_stats.filtered!=0xFFFF) ir_stats.filtered++;
+}
+while(0);
+else do {
+if(ir_stats.resets[ir_rx0.state]!=0xFFFF) ir_stats.resets[ir_rx0.state]++;
+}
+while(0);
+ir_rx0.state = IR_BURST;
+}
+while(0);
+}
+else {
+if((cnt_state>ir_rx0.win.zero_min)&&(cnt_state<ir_rx0.win.zero_max)) {
+ir_rx0.command &= ~(1<<ir_rx0.bitctr++);
+TCNT0 = 0;
+if(ir_rx0.bitctr>=8) {
+ir_rx0.state = IR_COMMAND_INV;
+ir_rx0.bitctr = 0;
+}
+break;
+}
+else if((cnt_state>ir_rx0.win.one_min)&&(cnt_state<ir_rx0.win.one_max)) {
+ir_rx0.command |= (1<<ir_rx0.bitctr++);
+TCNT0 = 0;
+if(ir_rx0.bitctr>=8) {
+ir_rx0.state = IR_COMMAND_INV;
+ir_rx0.bitctr = 0;
+}
+break;
+}
+do {
+((void)0);
+if((IR_CAP_WINDOW)==IR_CAP_FILTER) do {
+if(ir_stats.filtered!=0xFFFF) ir_stats.filtered++;
+}
+while(0);
+else do {
+if(ir_stats.resets[ir_rx0.state]!=0xFFFF) ir_stats.resets[ir_rx0.state]++;
+}
+while(0);
+ir_rx0.state = IR_BURST;
+}
+while(0);
+break;
+}
+break;
+case IR_COMMAND_INV: if(port_state) {
+if((cnt_state>ir_rx0.win.pulse_min)&&(cnt_state<ir_rx0.win.pulse_max)) {
+TCNT0 = 0;
+ir_rx0.mark_sum += cnt_state;
+break;
+}
+do {
+((void)0);
+if((IR_CAP_WINDOW)==IR_CAP_FILTER) do {
+if(ir_stats.filtered!=0xFFFF) ir_stats.filtered++;
+}
+while(0);
+else do {
+if(ir_stats.resets[ir_rx0.state]!=0xFFFF) ir_stats.resets[ir_rx0.state]++;
+}
+while(0);
+ir_rx0.state = IR_BURST;
+}
+while(0);
+}
+else {
+if((cnt_state>ir_rx0.win.zero_min)&&(cnt_state<ir_rx0.win.zero_max)) {
+if(!(ir_rx0.command&(1<<ir_rx0.bitctr++))) {
+do {
+((void)0);
+if((IR_CAP_CHECK)==IR_CAP_FILTER) do {
+if(ir_stats.filtered!=0xFFFF) ir_stats.filtered++;
+}
+while(0);
+else do {
+if(ir_stats.resets[ir_rx0.state]!=0xFFFF) ir_stats.resets[ir_rx0.state]++;
+}
+while(0);
+ir_rx0.state = IR_BURST;
+}
+while(0);
+break;
+}
+TCNT0 = 0;
+if(ir_rx0.bitctr>=8) {
+((void)0);
+ir_cal_learn(&ir_rx0);
+ir_rx0.state = IR_BURST;
+ir_deliver(&ir_rx0);
+ir_rx0.bitctr = 0;
+}
+break;
+}
+else if((cnt_state>ir_rx0.win.one_min)&&(cnt_state<ir_rx0.win.one_max)) {
+if(ir_rx0.command&(1<<ir_rx0.bitctr++)) {
+do {
+((void)0);
+if((IR_CAP_CHECK)==IR_CAP_FILTER) do {
+if(ir_stats.filtered!=0xFFFF) ir_stats.filtered++;
+}
+while(0);
+else do {
+if(ir_stats.resets[ir_rx0.state]!=0xFFFF) ir_stats.resets[ir_rx0.state]++;
+}
+while(0);
+ir_rx0.state = IR_BURST;
+}
+while(0);
+break;
+}
+TCNT0 = 0;
+if(ir_rx0.bitctr>=8) {
+((void)0);
+ir_cal_learn(&ir_rx0);
+ir_rx0.state = IR_BURST;
+ir_deliver(&ir_rx0);
+ir_rx0.bitctr = 0;
+}
+break;
+}
+do {
+((void)0);
+if((IR_CAP_WINDOW)==IR_CAP_FILTER) do {
+if(ir_stats.filtered!=0xFFFF) ir_stats.filtered++;
+}
+while(0);
+else do {
+if(ir_stats.resets[ir_rx0.state]!=0xFFFF) ir_stats.resets[ir_rx0.state]++;
+}
+while(0);
+ir_rx0.state = IR_BURST;
+}
+while(0);
+break;
+}
+break;
+}
+(GPIOR1--);
+}
+void TIMER0_OVF_vect(void) ;
+void TIMER0_OVF_vect(void) {
+do {
+if (++GPIOR1 > GPIOR2) GPIOR2 = GPIOR1;
+}
+while (0);
+ir_rx0.ovf = 1;
+if(ir_rx0.keyhold>0) {
+ir_rx0.keyhold--;
+if(( ir_rx0.keyhold==0 )) ir.status &= ~((1<<1) | (1<<2));
+}
+if(ir_rx0.keyhold==0) {
+( TCCR0B &= ~((1<<0) | (1<<1) | (1<<2)) );
+clkgov_release(0x02);
+}
+(GPIOR1--);
+}
@@ -0,0 +1,137 @@
+/*
+ * clockgov.c
+ *
+ * Clock governor: runs the system clock divided by CLKGOV_IDLE_DIV while
+ * nothing needs speed and at full F_CPU while IR, display or UI are busy.
+ *
+ * Timer1 prescaler and SPI divider are switched along with the system
+ * clock, so Timer1 keeps TIMER1_HZ ticks (no compare or counter rescale
+ * needed) and the MAX7219 sees the same SCK in both states. A display
+ * backend on Timer2 (DISPLAY_TIMER2) gets its prescaler switched the same
+ * way. Timer0 never needs rescaling: the IR decoder requests full speed
+ * before it starts Timer0 and releases it only after stopping it.
+ *
+ * Each switch may shift Timer1 phase by at most one tick (64us), as the
+ * shared prescaler counter keeps counting across the switch.
+ */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/power.h>
+#include "main.h"
+#include "clockgov.h"
+#include "display.h"
+
+#ifdef CLKGOV_ENABLE
+
+#if TIMER1_PRESCALER != 1024
+#error "Clock governor expects Timer1 prescaler 1024"
+#endif
+
+#if CLKGOV_IDLE_DIV == 16
+// 1MHz: Timer1 prescaler 64, SPI /4
+#define CLKGOV_CLOCK_DIV clock_div_16
+#define CLKGOV_T1_CS_IDLE ((1 << CS11) | (1 << CS10))
+#define CLKGOV_SPI_IDLE 0
+#define CLKGOV_T2_CS_IDLE (1 << CS21) // clk/8
+#elif CLKGOV_IDLE_DIV == 4
+// 4MHz: Timer1 prescaler 256, SPI /16
+#define CLKGOV_CLOCK_DIV clock_div_4
+#define CLKGOV_T1_CS_IDLE (1 << CS12)
+#define CLKGOV_SPI_IDLE (1 << SPR0)
+#define CLKGOV_T2_CS_IDLE ((1 << CS21) | (1 << CS20)) // clk/32
+#else
+#error "CLKGOV_IDLE_DIV must be 4 or 16"
+#endif
+
+#define CLKGOV_T1_CS_MASK ((1 << CS12) | (1 << CS11) | (1 << CS10))
+#define CLKGOV_T1_CS_FULL ((1 << CS12) | (1 << CS10)) // prescaler 1024
+#define CLKGOV_SPI_MASK ((1 << SPR1) | (1 << SPR0))
+#define CLKGOV_SPI_FULL (1 << SPR1) // prescaler 64
+#define CLKGOV_T2_CS_MASK ((1 << CS22) | (1 << CS21) | (1 << CS20))
+
+static volatile uint16_t clkgov_busy = CLKGOV_BOOT;
+
+/*
+ * Function: clkgov_full
+ * ---------------------
+ * Switches to full speed. Interrupts must be disabled.
+ */
+static void clkgov_full(void)
+{
+	clock_prescale_set(clock_div_1);
+	TCCR1B = (TCCR1B & ~CLKGOV_T1_CS_MASK) | CLKGOV_T1_CS_FULL;
+	SPCR = (SPCR & ~CLKGOV_SPI_MASK) | CLKGOV_SPI_FULL;
+#ifdef DISPLAY_TIMER2
+	TCCR2B = (TCCR2B & ~CLKGOV_T2_CS_MASK) | DISPLAY_T2_CS_FULL;
+#endif
+	return;
+}
+
+/*
+ * Function: clkgov_idle
+ * ---------------------
+ * Switches to the idle clock. Interrupts must be disabled.
+ */
+static void clkgov_idle(void)
+{
+	TCCR1B = (TCCR1B & ~CLKGOV_T1_CS_MASK) | CLKGOV_T1_CS_IDLE;
+	SPCR = (SPCR & ~CLKGOV_SPI_MASK) | CLKGOV_SPI_IDLE;
+#ifdef DISPLAY_TIMER2
+	TCCR2B = (TCCR2B & ~CLKGOV_T2_CS_MASK) | CLKGOV_T2_CS_IDLE;
+#endif
+	clock_prescale_set(CLKGOV_CLOCK_DIV);
+	return;
+}
+
+/*
+ * Function: clkgov_init
+ * ---------------------
+ * Releases the boot hold, called once Timer1 is running.
+ * Until then the clock stays at full speed.
+ */
+void clkgov_init(void)
+{
+	clkgov_release(CLKGOV_BOOT);
+	return;
+}
+
+/*
+ * Function: clkgov_request
+ * ------------------------
+ * Holds full speed for source until released. Safe from ISRs.
+ *
+ * source: one of the CLKGOV_ source bits
+ */
+void clkgov_request(uint16_t source)
+{
+	uint8_t sreg = SREG;
+	cli();
+	if (clkgov_busy == 0)
+		clkgov_full();
+	clkgov_busy |= source;
+	SREG = sreg;
+	return;
+}
+
+/*
+ * Function: clkgov_release
+ * ------------------------
+ * Drops the hold of source, the clock slows down when no holds are left.
+ *
+ * source: one of the CLKGOV_ source bits
+ */
+void clkgov_release(uint16_t source)
+{
+	uint8_t sreg = SREG;
+	cli();
+	if (clkgov_busy & source)
+	{
+		clkgov_busy &= ~source;
+		if (clkgov_busy == 0)
+			clkgov_idle();
+	}
+	SREG = sreg;
+	return;
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef CLOCKGOV_H
+#define CLOCKGOV_H
+
+#include <inttypes.h>
+
+// Comment this out to run at full speed all the time
+#define CLKGOV_ENABLE
+
+// System clock divider while idle: 4 or 16
+#define CLKGOV_IDLE_DIV 16
+
+// Sources that need full speed (bit mask)
+#define CLKGOV_BOOT 0x01	// until clkgov_init is called
+#define CLKGOV_IR 0x02		// IR frame or key hold in progress
+#define CLKGOV_DISPLAY 0x04 // display burst
+#define CLKGOV_UI 0x08		// modal user interface (editors, stopwatch)
+#define CLKGOV_TWI 0x10		// TWI transfer, bit rate is set for F_CPU
+#define CLKGOV_IRTX 0x20	// IR transmitter frame, carrier is set for F_CPU
+#define CLKGOV_IR1 0x40		// IR frame or key hold in progress, second receiver
+#define CLKGOV_POWERFAIL 0x80 // power-fail save, display shutdown at full speed
+#define CLKGOV_DISPLAY_BUS 0x100 // display transfer stepped by Timer2 (TM1637)
+
+#ifdef CLKGOV_ENABLE
+void clkgov_init(void);
+void clkgov_request(uint16_t source);
+void clkgov_release(uint16_t source);
+#else
+#define clkgov_init()
+#define clkgov_request(source)
+#define clkgov_release(source)
+#endif
+
+#endif
@@ -0,0 +1,272 @@
+/*
+ * display.c
+ *
+ * Display backend independent part: number formatting, the segment font
+ * of the backends that do not decode code B themselves, and the backend
+ * benchmark. The backend is picked with DISPLAY_BACKEND in display.h.
+ */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "main.h"
+#include "display.h"
+
+static uint8_t display_digits;
+
+// Code B font as segments, bit 0 = a ... bit 6 = g
+static const uint8_t display_font[16] = {
+	0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, // 0-7
+	0x7F, 0x6F, 0x40, 0x79, 0x76, 0x38, 0x73, 0x00	// 8, 9, -, E, H, L, P, blank
+};
+
+/*
+ * Function: display_init
+ * ----------------------
+ * Sets up the backend for digits 1 to digits, all blank
+ *
+ * digits: number of digits (1-8)
+ */
+void display_init(uint8_t digits)
+{
+	display_digits = digits;
+#if DISPLAY_BACKEND == DISPLAY_MAX7219
+	MAX7219_init();
+	MAX7219_scanLimit(digits);
+	MAX7219_decodeMode(3);
+#elif DISPLAY_BACKEND == DISPLAY_TM1637
+	tm1637_init(digits);
+#else
+	hc595_init(digits);
+#endif
+	display_blank(1, digits);
+	return;
+}
+
+/*
+ * Function: display_segments
+ * --------------------------
+ * Segments of a digit code, for backends without a code B decoder
+ *
+ * code: code B character, bit 7 = decimal point
+ *
+ * returns segments, bit 0 = a ... bit 6 = g, bit 7 = decimal point
+ */
+uint8_t display_segments(uint8_t code)
+{
+	return display_font[code & 0x0F] | (code & CODEB_DP);
+}
+
+/*
+ * Function: bcd4
+ * --------------
+ * Converts 0-9999 to 4 BCD digits, most significant first.
+ * The value is scaled to a 28 bit binary fraction of 10000 (exact for the
+ * whole range) and each digit is the integer part after multiplying by 10,
+ * so there is no branch on the value: one 16x16 multiply plus four
+ * shift-add steps.
+ *
+ * value: 0-9999
+ * digits: 4 bytes output
+ */
+static inline void bcd4(uint16_t value, uint8_t *digits)
+{
+	uint32_t frac = (uint32_t)value * 26844; // ceil(2^28 / 10000)
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		frac = (frac & 0x0FFFFFFFUL) * 10;
+		digits[i] = frac >> 28;
+	}
+	return;
+}
+
+/*
+ * Function: bcd8
+ * --------------
+ * Converts 0-99999999 to 8 BCD digits, most significant first.
+ * Values above 9999 take one 32 bit division to split into two bcd4
+ * halves, instead of one division per digit.
+ *
+ * value: 0-99999999
+ * digits: 8 bytes output
+ */
+static void bcd8(uint32_t value, uint8_t *digits)
+{
+	uint16_t high = 0;
+	if (value > 9999)
+		high = value / 10000;
+	bcd4(high, digits);
+	bcd4(value - (uint32_t)high * 10000, digits + 4);
+	return;
+}
+
+/*
+ * Function: display_setNumber
+ * ---------------------------
+ * Shows a signed number on a group of code B decoded digits, written
+ * left to right in one pass. Numbers that do not fit show all dashes.
+ *
+ * The conversion is not constant time: up to 9999 it is one bcd4 pass,
+ * above that bcd8 adds a 32 bit division. The old subtraction loop of
+ * set4digitNum took up to 36 iterations plus three 16 bit divisions.
+ * No cycle counts were measured for the old loop, bcd4 or bcd8.
+ *
+ * number: the number to be shown, negative numbers get a dash in front
+ * firstDigit: leftmost digit (1-8)
+ * width: number of digits (1-8), firstDigit + width - 1 must be <= 8
+ * dpDigit: digit (1-8) that gets the decimal point, 0 for none
+ * flags: DISPLAY_BLANK_ZEROS to blank leading zeros
+ */
+void display_setNumber(int32_t number, uint8_t firstDigit, uint8_t width, uint8_t dpDigit, uint8_t flags)
+{
+	uint8_t bcd[8], i, first, sign = 0xFF, negative = 0, overflow = 0, code;
+	uint32_t magnitude = number;
+	if ((width == 0) || (firstDigit == 0) || (firstDigit + width > 9))
+		return; // error
+	if (number < 0)
+	{
+		negative = 1;
+		magnitude = -(uint32_t)number;
+	}
+	if (magnitude > 99999999UL)
+		overflow = 1; // bcd[] stays unset, only dashes are shown
+	else
+	{
+		bcd8(magnitude, bcd);
+		/* Shown digits are bcd[8 - width] .. bcd[7] */
+		for (i = 0; i < 8 - width; i++)
+			overflow |= bcd[i];
+	}
+
+	/* First significant digit, zeros at or right of the point are kept */
+	first = 8 - width;
+	if ((flags & DISPLAY_BLANK_ZEROS) && !overflow)
+	{
+		while ((first < 7) && (bcd[first] == 0) && (first + firstDigit + width - 8 != dpDigit))
+			first++;
+	}
+	/* Sign goes right before the first shown digit, or replaces a leading zero */
+	if (negative && !overflow)
+	{
+		if (first > 8 - width)
+			sign = first - 1;
+		else if (bcd[first] == 0)
+			sign = first++;
+		else
+			overflow = 1; // no room for the sign
+	}
+
+	for (i = 8 - width; i < 8; i++)
+	{
+		if (overflow)
+			code = CODEB_DASH;
+		else if (i == sign)
+			code = CODEB_DASH;
+		else if (i >= first)
+			code = bcd[i];
+		else
+			code = CODEB_BLANK;
+		if (i + firstDigit + width - 8 == dpDigit)
+			code |= CODEB_DP;
+		display_setDigit(i + firstDigit + width - 8, code);
+	}
+	return;
+}
+
+/*
+ * Function: display_blank
+ * -----------------------
+ * Blanks a group of code B decoded digits
+ *
+ * firstDigit: leftmost digit (1-8)
+ * width: number of digits, firstDigit + width - 1 must be <= 8
+ */
+void display_blank(uint8_t firstDigit, uint8_t width)
+{
+	if ((firstDigit == 0) || (firstDigit + width > 9))
+		return; // error
+	while (width--)
+		display_setDigit(firstDigit++, CODEB_BLANK);
+	return;
+}
+
+#ifdef DISPLAY_BENCH
+/*
+ * Function: display_timer1
+ * ------------------------
+ * Timer1 count, read with interrupts off (16 bit TEMP register)
+ */
+static uint16_t display_timer1(void)
+{
+	uint8_t sreg = SREG;
+	uint16_t count;
+	cli();
+	count = TCNT1;
+	SREG = sreg;
+	return count;
+}
+
+/*
+ * Function: display_spin
+ * ----------------------
+ * Counts loop passes for DISPLAY_BENCH_TICKS, optionally after one full
+ * redraw at the start of the window. Fewer passes than with interrupts off
+ * is the CPU time taken by the redraw and by interrupts.
+ *
+ * redraw: 1 to redraw all digits first
+ *
+ * returns loop passes
+ */
+static uint32_t display_spin(uint8_t redraw)
+{
+	uint32_t count = 0;
+	uint16_t start = display_timer1();
+	if (redraw)
+	{
+		for (uint8_t i = 1; i <= display_digits; i++)
+			display_setDigit(i, 8);
+	}
+	while ((uint16_t)(display_timer1() - start) < DISPLAY_BENCH_TICKS)
+		count++;
+	return count;
+}
+
+/*
+ * Function: display_benchmark
+ * ---------------------------
+ * Measures the backend, at full speed (the caller holds the clock
+ * governor) and with Timer1 as the reference:
+ *		redrawCycles: CPU cycles of one full redraw on the caller side,
+ *			averaged over DISPLAY_BENCH_REDRAWS, interrupts stay on
+ *		loadPermille: CPU share of redrawing once per DISPLAY_BENCH_TICKS,
+ *			caller side plus the backend interrupts (TM1637 transfer,
+ *			HC595 multiplexing). Other interrupts are counted too, the
+ *			timer wheel adds about 1 per mille.
+ * The reference window runs with interrupts off.
+ * Leaves the digits showing 8.
+ *
+ * bench: where the results are stored
+ */
+void display_benchmark(struct display_bench *bench)
+{
+	uint32_t idle, busy;
+	uint16_t start;
+	uint8_t sreg = SREG;
+
+	start = display_timer1();
+	for (uint8_t n = 0; n < DISPLAY_BENCH_REDRAWS; n++)
+	{
+		for (uint8_t i = 1; i <= display_digits; i++)
+			display_setDigit(i, (n & 1) ? CODEB_BLANK : 8);
+	}
+	bench->redrawCycles = (uint32_t)(uint16_t)(display_timer1() - start) * TIMER1_PRESCALER / DISPLAY_BENCH_REDRAWS;
+
+	display_spin(0); // let a transfer still queued finish
+	cli();
+	idle = display_spin(0);
+	SREG = sreg;
+	busy = display_spin(1);
+	if (busy > idle)
+		busy = idle;
+	bench->loadPermille = (idle - busy) * 1000 / idle;
+	return;
+}
+#endif
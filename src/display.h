@@ -0,0 +1,88 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <inttypes.h>
+
+// Backends, pick one with DISPLAY_BACKEND
+#define DISPLAY_MAX7219 1 // MAX7219 over SPI, decodes code B itself
+#define DISPLAY_TM1637 2  // TM1637 module, bit-banged from Timer2 steps
+#define DISPLAY_HC595 3	  // 2x 74HC595 (segments, digit select), multiplexed from Timer2
+#ifndef DISPLAY_BACKEND
+#define DISPLAY_BACKEND DISPLAY_MAX7219
+#endif
+
+// Uncomment this for the display benchmark (ramstat pages), a test build
+// only: its calibration runs 10ms with interrupts off. Results per backend
+// are still to be taken on a board.
+//#define DISPLAY_BENCH
+#define DISPLAY_BENCH_REDRAWS 64 // full redraws timed for the foreground cost
+#define DISPLAY_BENCH_TICKS 156	// Timer1 ticks of the load window, 10ms (stopwatch refresh)
+
+/*
+ * Digit codes, all backends: code B font (MAX7219 datasheet) in bits 3:0,
+ * 0-9 are the numbers, bit 7 is the decimal point.
+ */
+#define CODEB_DASH 0x0A
+#define CODEB_E 0x0B
+#define CODEB_H 0x0C
+#define CODEB_L 0x0D
+#define CODEB_P 0x0E
+#define CODEB_BLANK 0x0F
+#define CODEB_DP 0x80
+
+// Flags for display_setNumber:
+#define DISPLAY_BLANK_ZEROS 0x01 // blank leading zeros
+
+#if DISPLAY_BACKEND == DISPLAY_MAX7219
+#include "MAX7219.h"
+#ifdef IR_LOOPBACK
+void irtx_displayed(void); // irtx.h, write done: end of the latency measured
+#define display_setDigit(digit, code)     \
+	do                                    \
+	{                                     \
+		MAX7219_setDigitNum(digit, code); \
+		irtx_displayed();                 \
+	} while (0)
+#else
+#define display_setDigit(digit, code) MAX7219_setDigitNum(digit, code)
+#endif
+#define display_shutdown(flag) MAX7219_shutdown(flag)
+#define display_shutdownISR(flag) MAX7219_shutdownISR(flag)
+#elif DISPLAY_BACKEND == DISPLAY_TM1637
+#include "tm1637.h"
+#define DISPLAY_TIMER2 // backend owns Timer2 (CTC, compare A)
+#define display_setDigit(digit, code) tm1637_setDigit(digit, code)
+#define display_shutdown(flag) tm1637_shutdown(flag)
+#define display_shutdownISR(flag) tm1637_shutdownISR(flag)
+#elif DISPLAY_BACKEND == DISPLAY_HC595
+#include "hc595.h"
+#define DISPLAY_TIMER2
+#define display_setDigit(digit, code) hc595_setDigit(digit, code)
+#define display_shutdown(flag) hc595_shutdown(flag)
+#define display_shutdownISR(flag) hc595_shutdown(flag)
+#else
+#error "DISPLAY_BACKEND must be DISPLAY_MAX7219, DISPLAY_TM1637 or DISPLAY_HC595"
+#endif
+
+/*
+ * Timer2 for the backends that need one: CTC at clk/128 (8us ticks at
+ * F_CPU), the clock governor switches the prescaler along with the system
+ * clock so the step rate stays the same.
+ */
+#define DISPLAY_T2_CS_FULL ((1 << CS22) | (1 << CS20)) // clk/128
+
+#ifdef DISPLAY_BENCH
+struct display_bench
+{
+	uint16_t redrawCycles; // CPU cycles of one full redraw, caller side
+	uint16_t loadPermille; // CPU taken by interrupts while the redraw is shown
+};
+void display_benchmark(struct display_bench *bench);
+#endif
+
+void display_init(uint8_t digits);
+void display_setNumber(int32_t number, uint8_t firstDigit, uint8_t width, uint8_t dpDigit, uint8_t flags);
+void display_blank(uint8_t firstDigit, uint8_t width);
+uint8_t display_segments(uint8_t code);
+
+#endif
@@ -0,0 +1,188 @@
+/*
+ * ds3231.c
+ *
+ * DS3231 RTC on the TWI driver. Reads and writes return at once, the
+ * result comes through a callback from the TWI ISR. The register coding
+ * (ds3231_decode/ds3231_encode) does not touch the bus.
+ */
+#include <avr/io.h>
+#include "ds3231.h"
+#include "twi.h"
+
+// Registers 0x00-0x0F: time, date, alarms, control and status
+#define DS3231_REGS 16
+#define DS3231_HOURS_12H 0x40
+#define DS3231_HOURS_PM 0x20
+#define DS3231_STATUS 0x0F
+#define DS3231_OSF 7 // status: oscillator stopped
+
+// Register address followed by the registers
+static uint8_t ds3231_buf[1 + DS3231_REGS];
+static struct ds3231_time ds3231_time;
+static ds3231_callback_t ds3231_done;
+
+/*
+ * Function: bcd_decode
+ * --------------------
+ * Two BCD digits to binary
+ */
+static inline uint8_t bcd_decode(uint8_t bcd)
+{
+	return (bcd >> 4) * 10 + (bcd & 0x0F);
+}
+
+/*
+ * Function: bcd_encode
+ * --------------------
+ * Binary (0-99) to two BCD digits
+ */
+static inline uint8_t bcd_encode(uint8_t value)
+{
+	return ((value / 10) << 4) | (value % 10);
+}
+
+/*
+ * Function: ds3231_init
+ * ---------------------
+ * Sets up the bus and the SQW input (pull-up, INT1 on falling edge).
+ * INT1 itself is enabled by the user of the ticks.
+ */
+void ds3231_init(void)
+{
+	twi_init();
+	DS3231_SQW_ddr &= ~(1 << DS3231_SQW_bit);
+	DS3231_SQW_port |= (1 << DS3231_SQW_bit);
+	EICRA = (EICRA & ~((1 << ISC11) | (1 << ISC10))) | (1 << ISC11);
+	return;
+}
+
+/*
+ * Function: ds3231_decode
+ * -----------------------
+ * Registers 0x00-0x03 to the time, 12h mode is converted to 24h
+ *
+ * regs: registers from 0x00
+ * time: where the time is stored
+ */
+void ds3231_decode(const uint8_t *regs, struct ds3231_time *time)
+{
+	time->seconds = bcd_decode(regs[0] & 0x7F);
+	time->minutes = bcd_decode(regs[1] & 0x7F);
+	if (regs[2] & DS3231_HOURS_12H)
+	{
+		time->hours = bcd_decode(regs[2] & 0x1F) % 12;
+		if (regs[2] & DS3231_HOURS_PM)
+			time->hours += 12;
+	}
+	else
+		time->hours = bcd_decode(regs[2] & 0x3F);
+	time->weekday = (regs[3] & 0x07) - 1;
+	if (time->weekday > 6)
+		time->weekday = 0;
+	return;
+}
+
+/*
+ * Function: ds3231_encode
+ * -----------------------
+ * The time to registers 0x00-0x0F. Date is set to 1/1/00 and the alarms
+ * are cleared (both unused), SQW is set to 1Hz and the oscillator stop
+ * flag is cleared.
+ *
+ * time: the time to set
+ * regs: where registers from 0x00 are stored
+ */
+void ds3231_encode(const struct ds3231_time *time, uint8_t *regs)
+{
+	uint8_t i;
+	for (i = 0; i < DS3231_REGS; i++)
+		regs[i] = 0; // control: oscillator on, SQW 1Hz; status: OSF cleared
+	regs[0] = bcd_encode(time->seconds);
+	regs[1] = bcd_encode(time->minutes);
+	regs[2] = bcd_encode(time->hours); // 24h mode
+	regs[3] = time->weekday + 1;
+	regs[4] = 1; // date
+	regs[5] = 1; // month
+	return;
+}
+
+/*
+ * Function: ds3231_readDone
+ * -------------------------
+ * TWI callback of ds3231_read
+ */
+static void ds3231_readDone(uint8_t status)
+{
+	if (status != TWI_OK)
+	{
+		ds3231_done(DS3231_FAILED, &ds3231_time);
+		return;
+	}
+	ds3231_decode(&ds3231_buf[1], &ds3231_time);
+	if (ds3231_buf[1 + DS3231_STATUS] & (1 << DS3231_OSF))
+		ds3231_done(DS3231_STOPPED, &ds3231_time);
+	else
+		ds3231_done(DS3231_OK, &ds3231_time);
+	return;
+}
+
+/*
+ * Function: ds3231_read
+ * ---------------------
+ * Starts reading the time, returns at once
+ *
+ * done: called from the TWI ISR with the result
+ * returns 0 if the bus is busy
+ */
+uint8_t ds3231_read(ds3231_callback_t done)
+{
+	if (twi_isBusy())
+		return 0;
+	ds3231_done = done;
+	ds3231_buf[0] = 0x00; // from the seconds register
+	return twi_transfer(DS3231_ADDRESS, ds3231_buf, 1, &ds3231_buf[1], DS3231_REGS, ds3231_readDone);
+}
+
+/*
+ * Function: ds3231_writeDone
+ * --------------------------
+ * TWI callback of ds3231_write
+ */
+static void ds3231_writeDone(uint8_t status)
+{
+	ds3231_done((status == TWI_OK) ? DS3231_OK : DS3231_FAILED, &ds3231_time);
+	return;
+}
+
+/*
+ * Function: ds3231_write
+ * ----------------------
+ * Starts setting the time, returns at once. Writing the seconds restarts
+ * the RTC second, the next SQW edge comes one second later.
+ *
+ * time: the time to set, copied
+ * done: called from the TWI ISR with the result
+ * returns 0 if the bus is busy
+ */
+uint8_t ds3231_write(const struct ds3231_time *time, ds3231_callback_t done)
+{
+	if (twi_isBusy())
+		return 0;
+	ds3231_done = done;
+	ds3231_time = *time;
+	ds3231_buf[0] = 0x00;
+	ds3231_encode(time, &ds3231_buf[1]);
+	return twi_transfer(DS3231_ADDRESS, ds3231_buf, sizeof(ds3231_buf), 0, 0, ds3231_writeDone);
+}
+
+/*
+ * Function: ds3231_abort
+ * ----------------------
+ * Gives up a read or write that takes too long, the callback gets
+ * DS3231_FAILED. Does nothing while the bus is idle.
+ */
+void ds3231_abort(void)
+{
+	twi_abort();
+	return;
+}
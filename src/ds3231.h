@@ -0,0 +1,41 @@
+#ifndef DS3231_H
+#define DS3231_H
+
+#include <inttypes.h>
+
+// 7 bit bus address
+#define DS3231_ADDRESS 0x68
+
+// SQW (open drain, 1Hz) on INT1, falling edge when the seconds advance
+#define DS3231_SQW_ddr DDRD
+#define DS3231_SQW_port PORTD
+#define DS3231_SQW_bit PORTD3
+
+// Result of a read or write, passed to the callback
+enum ds3231_status
+{
+	DS3231_OK,
+	DS3231_STOPPED, // oscillator stopped since last set, time is not valid
+	DS3231_FAILED,	// no answer on the bus
+};
+
+// Time of day as kept by the clock
+struct ds3231_time
+{
+	uint8_t seconds;
+	uint8_t minutes;
+	uint8_t hours; // 24h
+	uint8_t weekday; // 0 = day 1 ... 6 = day 7
+};
+
+// Called from the TWI ISR, time is only valid with DS3231_OK
+typedef void (*ds3231_callback_t)(uint8_t status, const struct ds3231_time *time);
+
+void ds3231_init(void);
+uint8_t ds3231_read(ds3231_callback_t done);
+uint8_t ds3231_write(const struct ds3231_time *time, ds3231_callback_t done);
+void ds3231_abort(void);
+void ds3231_decode(const uint8_t *regs, struct ds3231_time *time);
+void ds3231_encode(const struct ds3231_time *time, uint8_t *regs);
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * hc595.c
+ *
+ * 74HC595 display backend, multiplexed: every Timer2 compare interrupt
+ * shifts out the segments of the next digit and its digit line, so one
+ * digit is lit at a time. hc595_setDigit only stores the segments, the
+ * cost is in the interrupt, about 200 cycles per digit (bit-banged, the
+ * SPI divider belongs to the clock governor).
+ */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "main.h"
+#include "display.h"
+#include "ramstat.h"
+
+#if DISPLAY_BACKEND == DISPLAY_HC595
+
+#ifdef HC595_SEG_ACTIVE_LOW
+#define HC595_SEG(segments) ((uint8_t)~(segments))
+#else
+#define HC595_SEG(segments) (segments)
+#endif
+#ifdef HC595_DIGIT_ACTIVE_LOW
+#define HC595_DIGIT(mask) ((uint8_t)~(mask))
+#else
+#define HC595_DIGIT(mask) (mask)
+#endif
+
+static uint8_t hc595_digits;
+static volatile uint8_t hc595_segments[8]; // as shifted out, polarity applied
+static uint8_t hc595_next;				   // digit of the next interrupt, 0 = digit 1
+
+/*
+ * Function: hc595_shift
+ * ---------------------
+ * Shifts out a byte, MSB first
+ *
+ * byte: the byte to be sent
+ */
+static inline void hc595_shift(uint8_t byte)
+{
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		if (byte & 0x80)
+			HC595_port |= (1 << HC595_DATA);
+		else
+			HC595_port &= ~(1 << HC595_DATA);
+		HC595_port |= (1 << HC595_SCK);
+		HC595_port &= ~(1 << HC595_SCK);
+		byte <<= 1;
+	}
+	return;
+}
+
+/*
+ * Function: hc595_show
+ * --------------------
+ * Shifts out segments and digit lines and latches them
+ *
+ * segments: segment byte, polarity applied
+ * digits: digit line byte, polarity applied
+ */
+static void hc595_show(uint8_t segments, uint8_t digits)
+{
+	hc595_shift(segments);
+	hc595_shift(digits);
+	HC595_port |= (1 << HC595_LATCH);
+	HC595_port &= ~(1 << HC595_LATCH);
+	return;
+}
+
+/*
+ * Interrupt Service Routine, TIMER2_COMPA_vect
+ * --------------------------------------------
+ * Lights the next digit, every HC595_DIGIT_TICKS
+ */
+ISR(TIMER2_COMPA_vect)
+{
+	RAMSTAT_ISR_ENTER();
+	uint8_t i = hc595_next;
+	hc595_show(hc595_segments[i], HC595_DIGIT(1 << i));
+	if (++i >= hc595_digits)
+		i = 0;
+	hc595_next = i;
+	RAMSTAT_ISR_EXIT();
+}
+
+/*
+ * Function: hc595_init
+ * --------------------
+ * Sets up the pins and starts multiplexing from Timer2
+ *
+ * digits: number of digits (1-8)
+ */
+void hc595_init(uint8_t digits)
+{
+	hc595_digits = digits;
+	for (uint8_t i = 0; i < 8; i++)
+		hc595_segments[i] = HC595_SEG(0);
+	HC595_port &= ~((1 << HC595_SCK) | (1 << HC595_LATCH));
+	HC595_ddr |= (1 << HC595_SCK) | (1 << HC595_DATA) | (1 << HC595_LATCH);
+	TCCR2A = (1 << WGM21); // CTC
+	OCR2A = HC595_DIGIT_TICKS - 1;
+	TCCR2B = DISPLAY_T2_CS_FULL;
+	hc595_shutdown(0);
+	return;
+}
+
+/*
+ * Function: hc595_setDigit
+ * ------------------------
+ * Sets a digit, shown from the next multiplex turn
+ *
+ * digit: 1 (digit line bit 0) to the number of digits
+ * code: code B character, bit 7 = decimal point
+ */
+void hc595_setDigit(uint8_t digit, uint8_t code)
+{
+	if ((digit == 0) || (digit > hc595_digits))
+		return; // error
+	hc595_segments[digit - 1] = HC595_SEG(display_segments(code));
+	return;
+}
+
+/*
+ * Function: hc595_shutdown
+ * ------------------------
+ * Stops multiplexing with all digits dark, or starts it again.
+ * Safe from ISRs.
+ *
+ * shutdownFlag: if set to 1, the display is off, else is in normal mode
+ */
+void hc595_shutdown(uint8_t shutdownFlag)
+{
+	uint8_t sreg = SREG;
+	cli();
+	if (shutdownFlag)
+	{
+		TIMSK2 &= ~(1 << OCIE2A);
+		hc595_show(HC595_SEG(0), HC595_DIGIT(0));
+	}
+	else
+	{
+		TIFR2 = (1 << OCF2A);
+		TIMSK2 |= (1 << OCIE2A);
+	}
+	SREG = sreg;
+	return;
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef HC595_H
+#define HC595_H
+
+#include <inttypes.h>
+
+/*
+ * Two chained 74HC595: the first byte shifted out ends in the second
+ * register and drives the segments (bit 0 = a ... bit 7 = dp), the last
+ * byte drives the digit lines (bit 0 = digit 1). Same pins as the MAX7219.
+ */
+#define HC595_ddr DDRB
+#define HC595_port PORTB
+#define HC595_SCK PORTB5
+#define HC595_DATA PORTB3
+#define HC595_LATCH PORTB2
+
+#define HC595_SEG_ACTIVE_LOW // common anode, segment lines sink
+//#define HC595_DIGIT_ACTIVE_LOW
+
+#define HC595_DIGIT_TICKS 125 // Timer2 ticks (8us) per digit, 1ms
+
+void hc595_init(uint8_t digits);
+void hc595_setDigit(uint8_t digit, uint8_t code);
+void hc595_shutdown(uint8_t shutdownFlag);
+
+#endif
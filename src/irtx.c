@@ -0,0 +1,193 @@
+/*
+ * irtx.c
+ *
+ * NEC transmitter for the loopback self-test. Timer2 runs in CTC mode at
+ * clk/1 and toggles OC2B every compare match, which is the 38kHz carrier.
+ * Marks connect OC2B, spaces disconnect it (the pin then reads PORT, low).
+ * The compare A interrupt counts the half periods of each mark and space,
+ * so it runs every ~13us while a frame is sent (~30 cycles each) and is
+ * off otherwise. Timer2 is only held for the frame.
+ *
+ * Latency: the frame is complete at the start of the stop bit mark, the
+ * first display write after that (irtx_displayed) is the end of the path
+ * measured. It covers the receiver, the decoder, the main loop and the
+ * handler of the key, in Timer1 ticks.
+ */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "main.h"
+#include "clockgov.h"
+#include "irtx.h"
+#include "display.h"
+#include "ramstat.h"
+
+#ifdef IR_LOOPBACK
+
+#ifdef DISPLAY_TIMER2
+#error "IR_LOOPBACK needs Timer2, pick a display backend without it"
+#endif
+#ifdef RTC_DS3231
+#error "IR_LOOPBACK needs PD3, the DS3231 SQW input"
+#endif
+
+#define IRTX_EDGES (2 + 32 * 2 + 1) // AGC burst and gap, 32 bits, stop bit
+
+static volatile uint8_t irtx_busy;
+static uint8_t irtx_edge;	  // mark (even) or space (odd) being sent, 0 = AGC burst
+static uint16_t irtx_left;	  // half periods left of it
+static uint32_t irtx_bits;	  // frame, LSB first
+static uint32_t irtx_frameEnd; // Timer1 time the stop bit started
+static volatile uint8_t irtx_armed; // waiting for the first display write
+static volatile uint16_t irtx_ticks = IRTX_NO_LATENCY;
+
+/*
+ * Function: irtx_length
+ * ---------------------
+ * Length of a mark or space of the frame
+ *
+ * edge: 0 = AGC burst, 1 = gap, then bit marks and spaces, last the stop bit
+ *
+ * returns carrier half periods
+ */
+static uint16_t irtx_length(uint8_t edge)
+{
+	if (edge == 0)
+		return IRTX_HALVES(9000);
+	if (edge == 1)
+		return IRTX_HALVES(4500);
+	if (!(edge & 1))
+		return IRTX_HALVES(560);
+	if (irtx_bits & 1)
+		return IRTX_HALVES(1690);
+	return IRTX_HALVES(560);
+}
+
+/*
+ * Interrupt Service Routine, TIMER2_COMPA_vect
+ * --------------------------------------------
+ * Carrier half period, switches between mark and space
+ */
+ISR(TIMER2_COMPA_vect)
+{
+	RAMSTAT_ISR_ENTER();
+	if (--irtx_left)
+	{
+		RAMSTAT_ISR_EXIT();
+		return;
+	}
+	if ((irtx_edge & 1) && (irtx_edge > 1))
+		irtx_bits >>= 1; // bit space done
+	irtx_edge++;
+	if (irtx_edge == IRTX_EDGES) // stop bit done
+	{
+		TCCR2A = (1 << WGM21);
+		TCCR2B = 0;
+		TIMSK2 &= ~(1 << OCIE2A);
+		irtx_busy = 0;
+		clkgov_release(CLKGOV_IRTX);
+		RAMSTAT_ISR_EXIT();
+		return;
+	}
+	if (irtx_edge & 1)
+		TCCR2A = (1 << WGM21); // space
+	else
+	{
+		TCCR2A = (1 << COM2B0) | (1 << WGM21); // mark
+		if (irtx_edge == IRTX_EDGES - 1)
+		{
+			irtx_frameEnd = timer1_now();
+			irtx_ticks = IRTX_NO_LATENCY;
+			irtx_armed = 1;
+		}
+	}
+	irtx_left = irtx_length(irtx_edge);
+	RAMSTAT_ISR_EXIT();
+}
+
+/*
+ * Function: irtx_init
+ * -------------------
+ * Sets up the LED pin, off
+ */
+void irtx_init(void)
+{
+	IRTX_port &= ~(1 << IRTX_bit);
+	IRTX_ddr |= (1 << IRTX_bit);
+	return;
+}
+
+/*
+ * Function: irtx_send
+ * -------------------
+ * Starts sending a frame, runs in the background
+ *
+ * address: remote address
+ * command: command code
+ *
+ * returns 0 if a frame is still being sent
+ */
+uint8_t irtx_send(ir_addr_t address, uint8_t command)
+{
+	if (irtx_busy)
+		return 0;
+	irtx_busy = 1;
+	irtx_armed = 0;
+	clkgov_request(CLKGOV_IRTX); // carrier is set for F_CPU
+#ifdef PROTOCOL_NEC_EXTENDED
+	irtx_bits = address;
+#else
+	irtx_bits = address | ((uint16_t)(uint8_t)~address << 8);
+#endif
+	irtx_bits |= ((uint32_t)command << 16) | ((uint32_t)(uint8_t)~command << 24);
+	irtx_edge = 0;
+	irtx_left = irtx_length(0);
+	TCCR2A = (1 << COM2B0) | (1 << WGM21); // CTC, toggle OC2B: AGC burst
+	OCR2A = IRTX_OCR2A;
+	OCR2B = 0;
+	TCNT2 = 0;
+	TIFR2 = (1 << OCF2A);
+	TIMSK2 |= (1 << OCIE2A);
+	TCCR2B = (1 << CS20); // clk/1
+	return 1;
+}
+
+/*
+ * Function: irtx_isBusy
+ * ---------------------
+ * returns 1 while a frame is being sent
+ */
+uint8_t irtx_isBusy(void)
+{
+	return irtx_busy;
+}
+
+/*
+ * Function: irtx_latency
+ * ----------------------
+ * Latency of the last frame sent
+ *
+ * returns Timer1 ticks from the end of the frame to the first display
+ * write, IRTX_NO_LATENCY if nothing was written
+ */
+uint16_t irtx_latency(void)
+{
+	return irtx_ticks;
+}
+
+/*
+ * Function: irtx_displayed
+ * ------------------------
+ * Display write hook (display_setDigit), called when a write completed
+ */
+void irtx_displayed(void)
+{
+	uint32_t ticks;
+	if (!irtx_armed)
+		return;
+	irtx_armed = 0;
+	ticks = timer1_now() - irtx_frameEnd;
+	irtx_ticks = (ticks < IRTX_NO_LATENCY) ? ticks : IRTX_NO_LATENCY - 1;
+	return;
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef IRTX_H
+#define IRTX_H
+
+#include <inttypes.h>
+#include "libnecdecoder.h"
+
+/*
+ * NEC transmitter for the loopback self-test (IR_LOOPBACK in main.h):
+ * 38kHz carrier from Timer2 on OC2B, an IR LED (through a transistor)
+ * pointing at the receiver on PD2.
+ */
+#define IRTX_ddr DDRD
+#define IRTX_port PORTD
+#define IRTX_bit PORTD3 // OC2B
+
+#define IRTX_CARRIER_HZ 38000UL
+#define IRTX_OCR2A ((F_CPU + IRTX_CARRIER_HZ) / (2 * IRTX_CARRIER_HZ) - 1) // toggle per half period
+// Carrier half periods (Timer2 compare matches) in us microseconds, rounded
+#define IRTX_HALVES(us) ((uint16_t)(((uint32_t)(us) * (F_CPU / 1000000UL) + (IRTX_OCR2A + 1) / 2) / (IRTX_OCR2A + 1)))
+
+#define IRTX_NO_LATENCY 0xFFFF
+
+void irtx_init(void);
+uint8_t irtx_send(ir_addr_t address, uint8_t command);
+uint8_t irtx_isBusy(void);
+uint16_t irtx_latency(void);
+void irtx_displayed(void);
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * keymap.c
+ *
+ * Remote key to action map. The command code of a received frame indexes
+ * keymap[] directly, so dispatch costs the same for every key and any
+ * remote works once its keys are learned.
+ *
+ * EEPROM keeps the code of every learned action. It is only valid with
+ * KEYMAP_MAGIC, otherwise the default codes of keymap.h are used.
+ */
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include "main.h"
+#include "keymap.h"
+
+#define KEYMAP_MAGIC 0x4C // bumped when the EEPROM layout changes
+
+_Static_assert(KEY_ACTIONS <= 32, "Learned actions must fit the 32 bit mask");
+
+uint8_t keymap[256];
+
+/* EEPROM: code per action (index 0 unused) and the learned actions mask */
+uint8_t EEMEM ee_keymapMagic;
+uint32_t EEMEM ee_keymapLearned;
+uint8_t EEMEM ee_keymapCodes[KEY_ACTIONS];
+
+/*
+ * Function: keymap_build
+ * ----------------------
+ * Fills the lookup table, codes of actions not learned stay unmapped
+ *
+ * codes: command code per action
+ * learned: bit n set when action n has a code
+ */
+static void keymap_build(const uint8_t *codes, uint32_t learned)
+{
+	uint8_t action, i = 0;
+	do
+		keymap[i] = KEY_NONE;
+	while (++i);
+	for (action = KEY_DONE; action < KEY_ACTIONS; action++)
+	{
+		if (learned & (1UL << action))
+			keymap[codes[action]] = action;
+	}
+	return;
+}
+
+/*
+ * Function: keymap_load
+ * ---------------------
+ * Builds the lookup table from the learned keys, or from the defaults
+ * when none were learned yet
+ */
+void keymap_load(void)
+{
+	static const uint8_t digits[10] = {DIGIT_0_IRcommand, DIGIT_1_IRcommand, DIGIT_2_IRcommand, DIGIT_3_IRcommand,
+									   DIGIT_4_IRcommand, DIGIT_5_IRcommand, DIGIT_6_IRcommand, DIGIT_7_IRcommand,
+									   DIGIT_8_IRcommand, DIGIT_9_IRcommand};
+	uint8_t codes[KEY_ACTIONS], action, lock;
+	uint32_t learned;
+	if (keymap_isLearned())
+	{
+		lock = eeprom_lock();
+		eeprom_read_block(codes, ee_keymapCodes, sizeof(codes));
+		learned = eeprom_read_dword(&ee_keymapLearned);
+		eeprom_unlock(lock);
+	}
+	else
+	{
+		codes[KEY_DONE] = CLOCK_DONE_IRcommmand;
+		codes[KEY_INC_DIGIT] = INC_DIGIT_IRcommand;
+		codes[KEY_DEC_DIGIT] = DEC_DIGIT_IRcommand;
+		codes[KEY_INC_DIGIT_NUM] = INC_DIGIT_NUM_IRcommand;
+		codes[KEY_DEC_DIGIT_NUM] = DEC_DIGIT_NUM_IRcommand;
+		codes[KEY_ALARM_OFF] = ALARM_OFF_IRcommand;
+		codes[KEY_SET_ALARM] = SET_ALARM_IRcommand;
+		codes[KEY_LEARN_REMOTE] = LEARN_REMOTE_IRcommand;
+		codes[KEY_STOPWATCH] = STOPWATCH_IRcommand;
+		codes[KEY_COUNTDOWN] = COUNTDOWN_IRcommand;
+		codes[KEY_RAMSTAT] = RAMSTAT_IRcommand;
+		for (action = 0; action < 10; action++)
+			codes[KEY_DIGIT_0 + action] = digits[action];
+		learned = ((1UL << KEY_IRDUMP) - 1) & ~(1UL << KEY_NONE);
+	}
+	keymap_build(codes, learned);
+	return;
+}
+
+/*
+ * Function: keymap_save
+ * ---------------------
+ * Stores learned keys in EEPROM and switches the lookup table to them.
+ * The magic is cleared first, a write cut short falls back to the defaults.
+ *
+ * codes: command code per action
+ * learned: bit n set when action n has a code
+ */
+void keymap_save(const uint8_t *codes, uint32_t learned)
+{
+	uint8_t magic = 0xFF;
+	eeprom_store(&ee_keymapMagic, &magic, 1);
+	eeprom_store(ee_keymapCodes, codes, KEY_ACTIONS);
+	eeprom_store(&ee_keymapLearned, &learned, sizeof(learned));
+	magic = KEYMAP_MAGIC;
+	eeprom_store(&ee_keymapMagic, &magic, 1);
+	keymap_build(codes, learned);
+	return;
+}
+
+/*
+ * Function: keymap_command
+ * ------------------------
+ * Reverse lookup, the command code of an action (first match)
+ *
+ * action: enum key_action
+ * command: where the code is stored
+ *
+ * returns 0 if no key is mapped to action
+ */
+uint8_t keymap_command(uint8_t action, uint8_t *command)
+{
+	uint8_t i = 0;
+	do
+	{
+		if (keymap[i] == action)
+		{
+			*command = i;
+			return 1;
+		}
+	} while (++i);
+	return 0;
+}
+
+/*
+ * Function: keymap_isLearned
+ * --------------------------
+ * returns 1 if the map holds learned keys, 0 for the defaults
+ */
+uint8_t keymap_isLearned(void)
+{
+	uint8_t lock = eeprom_lock(), magic = eeprom_read_byte(&ee_keymapMagic);
+	eeprom_unlock(lock);
+	return magic == KEYMAP_MAGIC;
+}
@@ -0,0 +1,75 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <inttypes.h>
+
+/* Default codes (the stock 21 key remote), used until keys are learned */
+#define INC_DIGIT_NUM_IRcommand 0x0D
+#define DEC_DIGIT_NUM_IRcommand 0x19
+#define INC_DIGIT_IRcommand 0x43
+#define DEC_DIGIT_IRcommand 0x40
+#define CLOCK_DONE_IRcommmand 0x44
+#define SET_ALARM_IRcommand 0x46
+#define ALARM_OFF_IRcommand 0x45
+#define LEARN_REMOTE_IRcommand 0x47
+#define STOPWATCH_IRcommand 0x07
+#define COUNTDOWN_IRcommand 0x15
+#define RAMSTAT_IRcommand 0x09 // hidden, RAM use pages (ramstat.h)
+#define DIGIT_0_IRcommand 0x16
+#define DIGIT_1_IRcommand 0x0C
+#define DIGIT_2_IRcommand 0x18
+#define DIGIT_3_IRcommand 0x5E
+#define DIGIT_4_IRcommand 0x08
+#define DIGIT_5_IRcommand 0x1C
+#define DIGIT_6_IRcommand 0x5A
+#define DIGIT_7_IRcommand 0x42
+#define DIGIT_8_IRcommand 0x52
+#define DIGIT_9_IRcommand 0x4A
+
+/* What a remote key does, KEY_NONE for keys not mapped.
+ * Learn mode asks for the keys in this order. */
+enum key_action
+{
+	KEY_NONE,
+	KEY_DONE,
+	KEY_INC_DIGIT,
+	KEY_DEC_DIGIT,
+	KEY_INC_DIGIT_NUM,
+	KEY_DEC_DIGIT_NUM,
+	KEY_DIGIT_0, // KEY_DIGIT_0 + n is digit n
+	KEY_DIGIT_1,
+	KEY_DIGIT_2,
+	KEY_DIGIT_3,
+	KEY_DIGIT_4,
+	KEY_DIGIT_5,
+	KEY_DIGIT_6,
+	KEY_DIGIT_7,
+	KEY_DIGIT_8,
+	KEY_DIGIT_9,
+	KEY_ALARM_OFF,
+	KEY_SET_ALARM,
+	KEY_LEARN_REMOTE,
+	KEY_STOPWATCH,
+	KEY_COUNTDOWN,
+	KEY_RAMSTAT,
+	KEY_IRDUMP,		// no default key (IR_CAPTURE viewer)
+	KEY_LEARN_KEYS, // no default key
+	KEY_ACTIONS		// number of actions
+};
+
+/* The same unmapped key pressed this many times at the clock learns keys,
+ * from a remote passing the address filter or while the defaults are used */
+#define KEYMAP_LEARN_PRESSES 5
+/* Learning is abandoned, map unchanged, when no key comes for this long */
+#define KEYMAP_LEARN_TIMEOUT_MS 30000
+
+/* Command code to action, one entry per code */
+extern uint8_t keymap[256];
+#define keymap_action(command) (keymap[(uint8_t)(command)])
+
+void keymap_load(void);
+void keymap_save(const uint8_t *codes, uint32_t learned);
+uint8_t keymap_command(uint8_t action, uint8_t *command);
+uint8_t keymap_isLearned(void);
+
+#endif
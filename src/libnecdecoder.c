@@ -1,387 +1,490 @@
-#include <avr/io.h>
-#include <avr/interrupt.h>
-#include "libnecdecoder.h"
-
-
-volatile uint8_t ir_state;
-volatile uint8_t ir_bitctr;
-#ifdef PROTOCOL_NEC_EXTENDED
-volatile uint8_t ir_tmp_address_l;
-volatile uint8_t ir_tmp_address_h;
-#else
-volatile uint8_t ir_tmp_address;
-#endif
-volatile uint8_t ir_tmp_command;
-volatile uint8_t ir_tmp_keyhold;
-volatile uint8_t ir_tmp_ovf;
-
-
-// ###### Initializes ir function ######
-void ir_init( void )
-{
-	// tAGC_burst = 9ms, tBIT = 0.56ms
-	#if defined (__AVR_ATmega48__) || defined(__AVR_ATmega88__) || defined(__AVR_ATmega168__)
-	// Timer: 8bit, Clock: 8MHz, Prescaler 1024, Overflow = 32.768ms, Tick = 0.128ms
-	TCCR0A &= ~( (1<<COM0A0) | (1<<COM0A1) | (1<<COM0B0) | (1<<COM0B1) | (1<<WGM00) | (1<<WGM01) );
-	TCCR0B |= (1<<CS00) | (1<<CS02);
-	TIMSK0 |= (1<<TOIE0);
-	
-	// Interrupt 0 (PD2): Inverted signal input, triggered by logical change
-	DDRD   &= ~(1<<PD2);
-	EICRA  |= (1<<ISC00);
-	EIMSK  |= (1<<INT0);
-	#elif defined (__AVR_ATtiny2313__) || (__AVR_ATtiny4313__)
-	// Timer: 8bit, Clock: 8MHz, Prescaler 1024, Overflow = 32.768ms, Tick = 0.128ms
-	TCCR0A &= ~( (1<<COM0A0) | (1<<COM0A1) | (1<<COM0B0) | (1<<COM0B1) | (1<<WGM00) | (1<<WGM01) );
-	TCCR0B |= (1<<CS00) | (1<<CS02);
-	TIMSK  |= (1<<TOIE0);
-
-	// Interrupt 0 (PD2): Inverted signal input, triggered by logical change
-	DDRD   &= ~(1<<PD2);
-	MCUCR  |= (1<<ISC00);
-	GIMSK  |= (1<<INT0);
-	#elif defined (__AVR_ATmega328P__)
-	// Timer: 8bit, Clock: 16MHZ, Prescaler 1024, Overflow = 16.384ms, Tick = 0.064ms, Normal Mode, Oflow Interrupt Enabled
-	TCCR0A = 0;
-	TCCR0B |= (1<<CS00) | (1<<CS02);
-	TIMSK0 |= (1<<TOIE0);
-	
-	// Interrupt 0 (PD2): Inverted signal input, triggered by logical change
-	DDRD   &= ~(1<<PORTD2);
-	EICRA  |= (1<<ISC00);
-	EIMSK  |= (1<<INT0);
-	#else
-	#warning "MCU not supported"
-	#endif
-
-	// Reset state
-	ir_state = IR_BURST;
-	
-	// Reset global variables
-	ir_tmp_keyhold = 0;
-	ir_tmp_ovf = 0;
-	
-	// Global interrupt enable
-	sei();
-}
-
-
-// ###### Stops ir function ######
-void ir_stop( void )
-{
-	// Stop timer and disable interrupt
-	#if defined (__AVR_ATmega48__) || defined(__AVR_ATmega88__) || defined(__AVR_ATmega168__)
-	TCCR0B &= ~((1<<CS00) | (1<<CS02));
-	TIMSK0 &= ~(1<<TOIE0);
-	EIMSK  &= ~(1<<INT0);
-	#elif defined (__AVR_ATtiny2313__) || (__AVR_ATtiny4313__)
-	TCCR0B &= ~((1<<CS00) | (1<<CS02));
-	TIMSK  &= ~(1<<TOIE0);
-	GIMSK  &= ~(1<<INT0);
-	#elif defined (__AVR_ATmega328P__)
-	TCCR0B &= ~((1<<CS00) | (1<<CS02));
-	TIMSK0 &= ~(1<<TOIE0);
-	EIMSK  &= ~(1<<INT0);
-	#else
-	#warning "MCU not supported"
-	#endif
-}
-
-
-// ###### INT0 for decoding ######
-ISR( INT0_vect )
-{
-	// Get current port state to check if we triggered on rising or falling edge
-	uint8_t port_state = ( PIND & (1<<PD2) );
-	uint8_t cnt_state = TCNT0;
-
-	if(ir_tmp_ovf!=0)
-	{
-		// Overflow, so reset and ignore.
-		ir_tmp_ovf = 0;
-		ir_state = IR_BURST;
-		TCNT0 = 0;
-		return;
-	}
-
-	switch(ir_state)
-	{
-		case IR_BURST:
-		if(!port_state)
-		{
-			TCNT0 = 0; // Reset counter
-			} else {
-			if((cnt_state>TIME_BURST_MIN)&&(cnt_state<TIME_BURST_MAX))
-			{
-				ir_state = IR_GAP; // Next state
-				TCNT0 = 0; // Reset counter
-			}
-		}
-		break;
-		case IR_GAP:
-		if(!port_state)
-		{
-			if((cnt_state>TIME_GAP_MIN)&&(cnt_state<TIME_GAP_MAX))
-			{
-				TCNT0 = 0; // Reset counter
-				ir_state = IR_ADDRESS; // Next state
-				ir_bitctr = 0; // Reset bitcounter
-				ir.status &= ~(1<<IR_KEYHOLD);
-				break;
-			} else
-			if((cnt_state>TIME_HOLD_MIN)&&(cnt_state<TIME_HOLD_MAX))
-			{
-				if(ir.status & (1<<IR_SIGVALID))
-				{
-					ir.status |= (1<<IR_KEYHOLD);
-					ir_tmp_keyhold = IR_HOLD_OVF;
-				}
-				ir_state = IR_BURST;
-				break;
-			}
-		}
-		// Should not happen, must be invalid. Reset.
-		ir_state = IR_BURST;
-		break;
-		case IR_ADDRESS:
-		if(port_state)
-		{
-			// Must be short pulse
-			if((cnt_state>TIME_PULSE_MIN)&&(cnt_state<TIME_PULSE_MAX))
-			{
-				TCNT0 = 0; // Reset counter
-				break;
-			}
-			// Should not happen, must be invalid. Reset.
-			ir_state = IR_BURST;
-			} else {
-			if((cnt_state>TIME_ZERO_MIN)&&(cnt_state<TIME_ZERO_MAX))
-			{
-				// 0
-				#ifdef PROTOCOL_NEC_EXTENDED
-				ir_tmp_address_l &= ~(1<<ir_bitctr++);
-				#else
-				ir_tmp_address &= ~(1<<ir_bitctr++);
-				#endif
-				TCNT0 = 0; // Reset counter
-				if(ir_bitctr>=8)
-				{
-					ir_state = IR_ADDRESS_INV; // Next state
-					ir_bitctr = 0; // Reset bitcounter
-				}
-				break;
-			} else
-			if((cnt_state>TIME_ONE_MIN)&&(cnt_state<TIME_ONE_MAX))
-			{
-				// 1
-				#ifdef PROTOCOL_NEC_EXTENDED
-				ir_tmp_address_l |= (1<<ir_bitctr++);
-				#else
-				ir_tmp_address |= (1<<ir_bitctr++);
-				#endif
-				TCNT0 = 0; // Reset counter
-				if(ir_bitctr>=8)
-				{
-					ir_state = IR_ADDRESS_INV; // Next state
-					ir_bitctr = 0; // Reset bitcounter
-				}
-				break;
-			}
-			// Should not happen, must be invalid. Reset.
-			ir_state = IR_BURST;
-			break;
-		}
-		break;
-		case IR_ADDRESS_INV:
-		if(port_state)
-		{
-			// Must be short pulse
-			if((cnt_state>TIME_PULSE_MIN)&&(cnt_state<TIME_PULSE_MAX))
-			{
-				TCNT0 = 0; // Reset counter
-				break;
-			}
-			// Should not happen, must be invalid. Reset.
-			ir_state = IR_BURST;
-			} else {
-			if((cnt_state>TIME_ZERO_MIN)&&(cnt_state<TIME_ZERO_MAX))
-			{
-				// 0 (inverted) or high address
-				#ifdef PROTOCOL_NEC_EXTENDED
-				ir_tmp_address_h &= ~(1<<ir_bitctr++);
-				#else
-				if(!(ir_tmp_address&(1<<ir_bitctr++)))
-				{
-					// Should not happen, must be invalid. Reset.
-					ir_state = IR_BURST;
-					break;
-				}
-				#endif
-				TCNT0 = 0; // Reset counter
-				if(ir_bitctr>=8)
-				{
-					ir_state = IR_COMMAND; // Next state
-					ir_bitctr = 0; // Reset bitcounter
-				}
-				break;
-			} else
-			if((cnt_state>TIME_ONE_MIN)&&(cnt_state<TIME_ONE_MAX))
-			{
-				// 1 (inverted) or high address
-				#ifdef PROTOCOL_NEC_EXTENDED
-				ir_tmp_address_h |= (1<<ir_bitctr++);
-				#else
-				if(ir_tmp_address&(1<<ir_bitctr++))
-				{
-					// Should not happen, must be invalid. Reset.
-					ir_state = IR_BURST;
-					break;
-				}
-				#endif
-				TCNT0 = 0; // Reset counter
-				if(ir_bitctr>=8)
-				{
-					ir_state = IR_COMMAND; // Next state
-					ir_bitctr = 0; // Reset bitcounter
-				}
-				break;
-			}
-			// Should not happen, must be invalid. Reset.
-			ir_state = IR_BURST;
-			break;
-		}
-		break;
-		case IR_COMMAND:
-		if(port_state)
-		{
-			// Must be short pulse
-			if((cnt_state>TIME_PULSE_MIN)&&(cnt_state<TIME_PULSE_MAX))
-			{
-				TCNT0 = 0; // Reset counter
-				break;
-			}
-			// Should not happen, must be invalid. Reset.
-			ir_state = IR_BURST;
-			} else {
-			if((cnt_state>TIME_ZERO_MIN)&&(cnt_state<TIME_ZERO_MAX))
-			{
-				// 0
-				ir_tmp_command &= ~(1<<ir_bitctr++);
-				TCNT0 = 0; // Reset counter
-				if(ir_bitctr>=8)
-				{
-					ir_state = IR_COMMAND_INV; // Next state
-					ir_bitctr = 0; // Reset bitcounter
-				}
-				break;
-			} else
-			if((cnt_state>TIME_ONE_MIN)&&(cnt_state<TIME_ONE_MAX))
-			{
-				// 1
-				ir_tmp_command |= (1<<ir_bitctr++);
-				TCNT0 = 0; // Reset counter
-				if(ir_bitctr>=8)
-				{
-					ir_state = IR_COMMAND_INV; // Next state
-					ir_bitctr = 0; // Reset bitcounter
-				}
-				break;
-			}
-			// Should not happen, must be invalid. Reset.
-			ir_state = IR_BURST;
-			break;
-		}
-		break;
-		case IR_COMMAND_INV:
-		if(port_state)
-		{
-			// Must be short pulse
-			if((cnt_state>TIME_PULSE_MIN)&&(cnt_state<TIME_PULSE_MAX))
-			{
-				TCNT0 = 0; // Reset counter
-				break;
-			}
-			// Should not happen, must be invalid. Reset.
-			ir_state = IR_BURST;
-			} else {
-			if((cnt_state>TIME_ZERO_MIN)&&(cnt_state<TIME_ZERO_MAX))
-			{
-				// 0 (inverted)
-				if(!(ir_tmp_command&(1<<ir_bitctr++)))
-				{
-					// Should not happen, must be invalid. Reset.
-					ir_state = IR_BURST;
-					break;
-				}
-				TCNT0 = 0; // Reset counter
-				if(ir_bitctr>=8)
-				{
-					ir_state = IR_BURST; // Decoding finished.
-					// Only apply if received flag is not set, must be done
-					// by the main program after reading address and command
-					if(!(ir.status & (1<<IR_RECEIVED)))
-					{
-						#ifdef PROTOCOL_NEC_EXTENDED
-						ir.address_l = ir_tmp_address_l;
-						ir.address_h = ir_tmp_address_h;
-						#else
-						ir.address = ir_tmp_address;
-						#endif
-						ir.command = ir_tmp_command;
-						ir.status |= (1<<IR_RECEIVED) | (1<<IR_SIGVALID);
-						ir_tmp_keyhold = IR_HOLD_OVF; // To make shure that valid flag is cleared
-					}
-					ir_bitctr = 0; // Reset bitcounter
-				}
-				break;
-			} else
-			if((cnt_state>TIME_ONE_MIN)&&(cnt_state<TIME_ONE_MAX))
-			{
-				// 1 (inverted)
-				if(ir_tmp_command&(1<<ir_bitctr++))
-				{
-					// Should not happen, must be invalid. Reset.
-					ir_state = IR_BURST;
-					break;
-				}
-				TCNT0 = 0; // Reset counter
-				if(ir_bitctr>=8)
-				{
-					ir_state = IR_BURST; // Decoding finished.
-					// Only apply if received flag is not set, must be done
-					// by the main program after reading address and command
-					if(!(ir.status & (1<<IR_RECEIVED)))
-					{
-						#ifdef PROTOCOL_NEC_EXTENDED
-						ir.address_l = ir_tmp_address_l;
-						ir.address_h = ir_tmp_address_h;
-						#else
-						ir.address = ir_tmp_address;
-						#endif
-						ir.command = ir_tmp_command;
-						ir.status |= (1<<IR_RECEIVED) | (1<<IR_SIGVALID);
-						ir_tmp_keyhold = IR_HOLD_OVF; // To make shure that valid flag is cleared
-					}
-					ir_bitctr = 0; // Reset bitcounter
-				}
-				break;
-			}
-			// Should not happen, must be invalid. Reset.
-			ir_state = IR_BURST;
-			break;
-		}
-		break;
-	}
-}
-
-
-// ###### Timer 0 Overflow for hold flag clear ######
-ISR (TIMER0_OVF_vect)
-{
-	ir_tmp_ovf = 1;
-	if(ir_tmp_keyhold>0)
-	{
-		ir_tmp_keyhold--;
-		if(ir_tmp_keyhold==0) ir.status &= ~((1<<IR_KEYHOLD) | (1<<IR_SIGVALID));
-	}
-}
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "libnecdecoder.h"
+#include "main.h"
+#include "display.h"
+#include "clockgov.h"
+#include "ramstat.h"
+
+
+// Clock select bits for the configured prescaler, Timer 0 and Timer 2
+#if IR_TIMER_PRESCALER == 1024
+#define IR_TIMER_CS  ( (1<<CS00) | (1<<CS02) )
+#define IR_TIMER2_CS ( (1<<CS20) | (1<<CS21) | (1<<CS22) )
+#elif IR_TIMER_PRESCALER == 256
+#define IR_TIMER_CS  ( 1<<CS02 )
+#define IR_TIMER2_CS ( (1<<CS21) | (1<<CS22) )
+#elif IR_TIMER_PRESCALER == 64
+#define IR_TIMER_CS  ( (1<<CS00) | (1<<CS01) )
+#define IR_TIMER2_CS ( 1<<CS22 )
+#else
+#error "IR_TIMER_PRESCALER must be 64, 256 or 1024"
+#endif
+
+// The second receiver takes Timer 2 and its input pin
+#ifdef IR_RX1
+#ifndef __AVR_ATmega328P__
+#error "IR_RX1 is for the ATmega328P"
+#endif
+#ifdef DISPLAY_TIMER2
+#error "IR_RX1 needs Timer 2, pick a display backend without it"
+#endif
+#ifdef IR_LOOPBACK
+#error "IR_RX1 needs Timer 2, the IR_LOOPBACK carrier"
+#endif
+#if defined(IR_RX1_INT1) && defined(RTC_DS3231)
+#error "IR_RX1_INT1 needs INT1, the DS3231 SQW input"
+#endif
+#endif
+
+// Windows must fit the 8 bit timer, stay resolvable and not overlap
+_Static_assert( TIME_BURST_MAX <= 255, "AGC burst does not fit Timer 0, lower IR_TIMER_PRESCALER" );
+_Static_assert( TIME_PULSE_MIN + 1 < TIME_PULSE_MAX, "Bit pulse window empty, raise F_CPU or lower IR_TIMER_PRESCALER" );
+_Static_assert( TIME_ZERO_MIN + 1 < TIME_ZERO_MAX, "Zero window empty, raise F_CPU or lower IR_TIMER_PRESCALER" );
+_Static_assert( TIME_ZERO_MAX <= TIME_ONE_MIN + 1, "Zero and one windows overlap, lower IR_TOLERANCE_PCT" );
+_Static_assert( TIME_HOLD_MAX <= TIME_GAP_MIN + 1, "Hold and gap windows overlap, lower IR_TOLERANCE_PCT" );
+_Static_assert( TIME_GAP_MAX <= TIME_BURST_MIN + 1, "Gap and burst windows overlap, lower IR_TOLERANCE_PCT" );
+_Static_assert( IR_HOLD_OVF >= 1 && IR_HOLD_OVF <= 255, "Key hold timeout out of range" );
+// Scaled gap of the slowest accepted burst must stay below the burst window
+_Static_assert( IR_WINDOW_MAX_PCT(4500, IR_TOLERANCE_PCT + IR_CAL_RANGE_PCT) <= TIME_BURST_MIN + 1, "Gap and burst windows overlap, lower IR_CAL_RANGE_PCT" );
+
+// Nominal times as Q8 fractions of the AGC burst (9ms)
+#define IR_CAL_GAP   128 // 4.5ms
+#define IR_CAL_HOLD   64 // 2.25ms
+#define IR_CAL_PULSE  16 // 560us (15.9)
+#define IR_CAL_ONE    48 // 1.69ms (48.1)
+// Tolerance as Q8 fraction and jitter in ticks
+#define IR_CAL_TOL    ( (IR_TOLERANCE_PCT * 256 + 50) / 100 )
+#define IR_CAL_JITTER ( (uint8_t)IR_TICKS(IR_JITTER_US) )
+// Learned mark offset limit, ticks in Q4
+#define IR_CAL_OFFSET_MAX ( 2 * 16 )
+
+// State of one receiver. Each receiver is a static instance, so every
+// member has a fixed address and the handlers access it like a global.
+struct ir_rx
+ {
+  uint8_t state;
+  uint8_t bitctr;
+  #ifdef PROTOCOL_NEC_EXTENDED
+  uint8_t address_l;
+  uint8_t address_h;
+  #else
+  uint8_t address;
+  #endif
+  uint8_t command;
+  uint8_t keyhold;
+  uint8_t ovf;
+  // Windows of the frame in progress, scaled from its burst
+  struct
+   {
+    uint8_t gap_min, gap_max;
+    uint8_t hold_min, hold_max;
+    uint8_t pulse_min, pulse_max;
+    uint8_t zero_min, zero_max;
+    uint8_t one_min, one_max;
+   } win;
+  // Per remote mark stretch of the receiver/remote pair (ticks, Q4),
+  // indexed like the address filter. Applied from the next frame on.
+  int8_t cal_offset[IR_ADDR_FILTER_MAX];
+  uint8_t cal_slot; // Remote of the last accepted address
+  uint8_t cal_burst; // Burst of the frame in progress
+  uint16_t mark_sum; // Sum of the bit marks of the frame in progress
+ };
+
+static struct ir_rx ir_rx0; // INT0 (PD2), Timer 0
+#ifdef IR_RX1
+static struct ir_rx ir_rx1; // INT1 (PD3) or PCINT0 (PB0), Timer 2
+// A frame seen by both receivers is delivered by the first one done,
+// cleared at every AGC burst
+static uint8_t ir_rx_delivered;
+#endif
+
+// Timers are only clocked while a frame or key hold is in progress
+#define IR_TIMER_START() ( TCCR0B |= IR_TIMER_CS )
+#define IR_TIMER_STOP()  ( TCCR0B &= ~((1<<CS00) | (1<<CS01) | (1<<CS02)) )
+#define IR_TIMER2_START() ( TCCR2B |= IR_TIMER2_CS )
+#define IR_TIMER2_STOP()  ( TCCR2B &= ~((1<<CS20) | (1<<CS21) | (1<<CS22)) )
+
+// With two receivers the helpers taking a receiver are inlined into each
+// receiver's handlers, so rx-> becomes a fixed address. A single receiver
+// build leaves inlining to the compiler, like the helpers did before.
+#ifdef IR_RX1
+#define IR_RX_INLINE static inline __attribute__((always_inline))
+#else
+#define IR_RX_INLINE static inline
+#endif
+
+// Key hold ends when no receiver sees repeats any more
+#ifdef IR_RX1
+#define IR_KEYHOLD_OVER() ( ir_rx0.keyhold==0 && ir_rx1.keyhold==0 )
+#else
+#define IR_KEYHOLD_OVER() ( ir_rx0.keyhold==0 )
+#endif
+
+// Accepted addresses, only read by the ISR
+static ir_addr_t ir_filter[IR_ADDR_FILTER_MAX];
+static uint8_t ir_filter_cnt;
+
+
+// ###### Checks address against filter, remembers the matching remote ######
+IR_RX_INLINE uint8_t ir_addr_accept( struct ir_rx *rx, ir_addr_t address )
+{
+	uint8_t i;
+	if(ir_filter_cnt==0)
+	{
+		rx->cal_slot = 0;
+		return 1; // No filter, accept all
+	}
+	for(i=0;i<ir_filter_cnt;i++)
+	{
+		if(ir_filter[i]==address)
+		{
+			rx->cal_slot = i;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+// ###### Window around a nominal time (ticks, Q8) ######
+static void ir_window( uint16_t nominal, uint8_t *min, uint8_t *max )
+{
+	uint16_t delta = (nominal>>8) * IR_CAL_TOL;
+	int16_t lo = (int16_t)((nominal - delta)>>8) - IR_CAL_JITTER;
+	uint16_t hi = ((nominal + delta)>>8) + IR_CAL_JITTER + 1;
+	*min = lo<0 ? 0 : lo;
+	*max = hi>255 ? 255 : hi;
+}
+
+
+// ###### Scales the windows from the measured AGC burst ######
+IR_RX_INLINE void ir_calibrate( struct ir_rx *rx, uint8_t burst )
+{
+	// Marks stretched and spaces shortened by the learned offset (Q4 to Q8)
+	int16_t offset = (int16_t)rx->cal_offset[rx->cal_slot] << 4;
+	rx->cal_burst = burst;
+	rx->mark_sum = 0;
+	ir_window( (uint16_t)burst * IR_CAL_GAP, &rx->win.gap_min, &rx->win.gap_max );
+	ir_window( (uint16_t)burst * IR_CAL_HOLD, &rx->win.hold_min, &rx->win.hold_max );
+	ir_window( (uint16_t)burst * IR_CAL_PULSE + offset, &rx->win.pulse_min, &rx->win.pulse_max );
+	ir_window( (uint16_t)burst * IR_CAL_PULSE - offset, &rx->win.zero_min, &rx->win.zero_max );
+	ir_window( (uint16_t)burst * IR_CAL_ONE - offset, &rx->win.one_min, &rx->win.one_max );
+	#ifdef IR_RX1
+	ir_rx_delivered = 0; // New frame
+	#endif
+}
+
+
+// ###### Learns the mark offset of the remote from a good frame ######
+IR_RX_INLINE void ir_cal_learn( struct ir_rx *rx )
+{
+	// Average of the 32 marks against the scaled nominal, both ticks Q4
+	int16_t error = (int16_t)(rx->mark_sum>>1) - (int16_t)(((uint16_t)rx->cal_burst * IR_CAL_PULSE)>>4);
+	int16_t offset = rx->cal_offset[rx->cal_slot];
+	offset += (error - offset) / 4; // Smoothed over a few frames
+	if(offset>IR_CAL_OFFSET_MAX) offset = IR_CAL_OFFSET_MAX;
+	if(offset<-IR_CAL_OFFSET_MAX) offset = -IR_CAL_OFFSET_MAX;
+	rx->cal_offset[rx->cal_slot] = offset;
+}
+
+
+// ###### Resets a receiver, its timer is idle so the first edge counts as overflow ######
+static void ir_rx_reset( struct ir_rx *rx )
+{
+	rx->state = IR_BURST;
+	rx->keyhold = 0;
+	rx->ovf = 1;
+}
+
+
+#ifdef IR_CAPTURE
+// Ring of the last frames, ir_cap_head is the one being recorded
+static struct ir_capture ir_cap[IR_CAPTURE_FRAMES];
+static uint8_t ir_cap_head;
+static uint8_t ir_cap_cnt; // Finished frames in the ring
+static uint8_t ir_cap_open; // Frame being recorded
+static uint8_t ir_cap_paused;
+
+
+// ###### Starts recording a frame at the AGC burst edge ######
+static inline void ir_cap_begin( void )
+{
+	if(ir_cap_paused) return;
+	ir_cap[ir_cap_head].edges_cnt = 0;
+	ir_cap_open = 1;
+}
+
+
+// ###### Records the ticks since the previous edge ######
+static inline void ir_cap_edge( uint8_t cnt )
+{
+	struct ir_capture *frame = &ir_cap[ir_cap_head];
+	if(ir_cap_open && (frame->edges_cnt<IR_CAPTURE_EDGES)) frame->edges[frame->edges_cnt++] = cnt;
+}
+
+
+// ###### Finishes the frame being recorded ######
+static void ir_cap_end( uint8_t reason, uint8_t state, uint8_t cnt )
+{
+	if(!ir_cap_open) return;
+	ir_cap_open = 0;
+	ir_cap[ir_cap_head].reason = reason;
+	ir_cap[ir_cap_head].state = state;
+	ir_cap[ir_cap_head].count = cnt;
+	if(++ir_cap_head>=IR_CAPTURE_FRAMES) ir_cap_head = 0;
+	if(ir_cap_cnt<IR_CAPTURE_FRAMES) ir_cap_cnt++;
+}
+#else
+#define ir_cap_begin() ((void)0)
+#define ir_cap_edge(cnt) ((void)0)
+#define ir_cap_end(reason, state, cnt) ((void)0)
+#endif
+
+#ifdef IR_STATS
+// Health counters, saturating at 0xFFFF
+static struct ir_stats_struct ir_stats;
+_Static_assert( sizeof(ir_stats.resets) / sizeof(ir_stats.resets[0]) == IR_COMMAND_INV + 1, "One reset counter per state" );
+#define IR_STAT(counter) do { if(ir_stats.counter!=0xFFFF) ir_stats.counter++; } while(0)
+#else
+#define IR_STAT(counter) ((void)0)
+#endif
+
+
+
+// ###### Hands a decoded frame to the main program ######
+IR_RX_INLINE void ir_deliver( struct ir_rx *rx )
+{
+	#ifdef IR_RX1
+	if(ir_rx_delivered) return; // The other receiver was first
+	ir_rx_delivered = 1;
+	#endif
+	// Only apply if received flag is not set, must be done
+	// by the main program after reading address and command
+	if(!(ir.status & (1<<IR_RECEIVED)))
+	{
+		#ifdef PROTOCOL_NEC_EXTENDED
+		ir.address_l = rx->address_l;
+		ir.address_h = rx->address_h;
+		#else
+		ir.address = rx->address;
+		#endif
+		ir.command = rx->command;
+		ir.status |= (1<<IR_RECEIVED) | (1<<IR_SIGVALID);
+		rx->keyhold = IR_HOLD_OVF; // To make shure that valid flag is cleared
+		IR_STAT(frames);
+	} else IR_STAT(dropped);
+}
+
+
+// ###### Initializes ir function ######
+void ir_init( void )
+{
+	// tAGC_burst = 9ms, tBIT = 0.56ms
+	#if defined (__AVR_ATmega48__) || defined(__AVR_ATmega88__) || defined(__AVR_ATmega168__)
+	// Timer: 8bit, Clock: F_CPU, Prescaler IR_TIMER_PRESCALER, Overflow Interrupt Enabled
+	TCCR0A &= ~( (1<<COM0A0) | (1<<COM0A1) | (1<<COM0B0) | (1<<COM0B1) | (1<<WGM00) | (1<<WGM01) );
+	IR_TIMER_STOP(); // Started by the first edge
+	TIMSK0 |= (1<<TOIE0);
+	
+	// Interrupt 0 (PD2): Inverted signal input, triggered by logical change
+	DDRD   &= ~(1<<PD2);
+	EICRA  |= (1<<ISC00);
+	EIMSK  |= (1<<INT0);
+	#elif defined (__AVR_ATtiny2313__) || (__AVR_ATtiny4313__)
+	// Timer: 8bit, Clock: F_CPU, Prescaler IR_TIMER_PRESCALER, Overflow Interrupt Enabled
+	TCCR0A &= ~( (1<<COM0A0) | (1<<COM0A1) | (1<<COM0B0) | (1<<COM0B1) | (1<<WGM00) | (1<<WGM01) );
+	IR_TIMER_STOP(); // Started by the first edge
+	TIMSK  |= (1<<TOIE0);
+
+	// Interrupt 0 (PD2): Inverted signal input, triggered by logical change
+	DDRD   &= ~(1<<PD2);
+	MCUCR  |= (1<<ISC00);
+	GIMSK  |= (1<<INT0);
+	#elif defined (__AVR_ATmega328P__)
+	// Timer: 8bit, Clock: F_CPU, Prescaler IR_TIMER_PRESCALER, Normal Mode, Oflow Interrupt Enabled
+	// (16MHz/1024: Overflow = 16.384ms, Tick = 0.064ms)
+	TCCR0A = 0;
+	IR_TIMER_STOP(); // Started by the first edge
+	TIMSK0 |= (1<<TOIE0);
+	
+	// Interrupt 0 (PD2): Inverted signal input, triggered by logical change
+	DDRD   &= ~(1<<PORTD2);
+	EICRA  |= (1<<ISC00);
+	EIMSK  |= (1<<INT0);
+	#else
+	#warning "MCU not supported"
+	#endif
+
+	ir_rx_reset(&ir_rx0);
+
+	#ifdef IR_RX1
+	// Timer 2 like Timer 0 above
+	TCCR2A = 0;
+	IR_TIMER2_STOP(); // Started by the first edge
+	TIMSK2 |= (1<<TOIE2);
+	#ifdef IR_RX1_INT1
+	// Interrupt 1 (PD3): Inverted signal input, triggered by logical change
+	DDRD   &= ~(1<<PORTD3);
+	EICRA  |= (1<<ISC10);
+	EIMSK  |= (1<<INT1);
+	#else
+	// Pin change 0 (PB0), the only pin enabled on its port
+	DDRB   &= ~(1<<PORTB0);
+	PCMSK0 |= (1<<PCINT0);
+	PCICR  |= (1<<PCIE0);
+	#endif
+	ir_rx_reset(&ir_rx1);
+	#endif
+	
+	// Global interrupt enable
+	sei();
+}
+
+
+// ###### Stops ir function ######
+void ir_stop( void )
+{
+	// Stop timer and disable interrupt
+	#if defined (__AVR_ATmega48__) || defined(__AVR_ATmega88__) || defined(__AVR_ATmega168__)
+	IR_TIMER_STOP();
+	TIMSK0 &= ~(1<<TOIE0);
+	EIMSK  &= ~(1<<INT0);
+	#elif defined (__AVR_ATtiny2313__) || (__AVR_ATtiny4313__)
+	IR_TIMER_STOP();
+	TIMSK  &= ~(1<<TOIE0);
+	GIMSK  &= ~(1<<INT0);
+	#elif defined (__AVR_ATmega328P__)
+	IR_TIMER_STOP();
+	TIMSK0 &= ~(1<<TOIE0);
+	EIMSK  &= ~(1<<INT0);
+	#else
+	#warning "MCU not supported"
+	#endif
+
+	#ifdef IR_RX1
+	IR_TIMER2_STOP();
+	TIMSK2 &= ~(1<<TOIE2);
+	#ifdef IR_RX1_INT1
+	EIMSK  &= ~(1<<INT1);
+	#else
+	PCICR  &= ~(1<<PCIE0);
+	#endif
+	#endif
+}
+
+
+// ###### Sets accepted remote addresses (count 0 accepts all) ######
+void ir_setAddressFilter( const ir_addr_t *addresses, uint8_t count )
+{
+	uint8_t i;
+	uint8_t sreg = SREG;
+	if(count>IR_ADDR_FILTER_MAX) count = IR_ADDR_FILTER_MAX;
+	cli();
+	for(i=0;i<count;i++) ir_filter[i] = addresses[i];
+	for(i=0;i<IR_ADDR_FILTER_MAX;i++) ir_rx0.cal_offset[i] = 0; // Slots changed, relearn
+	ir_rx0.cal_slot = 0;
+	#ifdef IR_RX1
+	for(i=0;i<IR_ADDR_FILTER_MAX;i++) ir_rx1.cal_offset[i] = 0;
+	ir_rx1.cal_slot = 0;
+	#endif
+	ir_filter_cnt = count;
+	SREG = sreg;
+}
+
+
+
+#ifdef IR_CAPTURE
+// ###### Copies a captured frame, age 0 is the newest. Returns 0 if none ######
+uint8_t ir_captureGet( uint8_t age, struct ir_capture *frame )
+{
+	uint8_t i;
+	uint8_t sreg = SREG;
+	cli();
+	if(age>=ir_cap_cnt)
+	{
+		SREG = sreg;
+		return 0;
+	}
+	i = (ir_cap_head + IR_CAPTURE_FRAMES - 1 - age) % IR_CAPTURE_FRAMES;
+	*frame = ir_cap[i];
+	SREG = sreg;
+	return 1;
+}
+
+
+// ###### Stops (1) or resumes (0) recording, keeps the ring while inspected ######
+void ir_capturePause( uint8_t pause )
+{
+	uint8_t sreg = SREG;
+	cli();
+	ir_cap_paused = pause;
+	ir_cap_open = 0; // Drop a partial frame
+	SREG = sreg;
+}
+
+
+// ###### Forgets all captured frames ######
+void ir_captureClear( void )
+{
+	uint8_t sreg = SREG;
+	cli();
+	ir_cap_cnt = 0;
+	ir_cap_open = 0;
+	SREG = sreg;
+}
+#endif
+
+
+#ifdef IR_STATS
+// ###### Copies the health counters, clears them if clear is set ######
+void ir_statsGet( struct ir_stats_struct *stats, uint8_t clear )
+{
+	uint8_t i;
+	uint8_t sreg = SREG;
+	cli();
+	*stats = ir_stats;
+	if(clear)
+	{
+		for(i=0;i<sizeof(ir_stats);i++) ((uint8_t *)&ir_stats)[i] = 0;
+	}
+	SREG = sreg;
+}
+#endif
+
+
+
+// ###### Receiver 0: INT0 (PD2), Timer 0 ######
+#define IR_RX ir_rx0
+#define IR_RX_EDGE_VECT INT0_vect
+#define IR_RX_PIN PIND
+#define IR_RX_BIT PD2
+#define IR_RX_TCNT TCNT0
+#define IR_RX_TIMER_START() IR_TIMER_START()
+#define IR_RX_TIMER_STOP() IR_TIMER_STOP()
+#define IR_RX_OVF_VECT TIMER0_OVF_vect
+#define IR_RX_CLKGOV CLKGOV_IR
+#define IR_RX_CAPTURE 1
+#include "libnecdecoder_rx.h"
+
+
+#ifdef IR_RX1
+// ###### Receiver 1: INT1 (PD3) or PCINT0 (PB0), Timer 2 ######
+#define IR_RX ir_rx1
+#ifdef IR_RX1_INT1
+#define IR_RX_EDGE_VECT INT1_vect
+#define IR_RX_PIN PIND
+#define IR_RX_BIT PD3
+#else
+#define IR_RX_EDGE_VECT PCINT0_vect
+#define IR_RX_PIN PINB
+#define IR_RX_BIT PB0
+#endif
+#define IR_RX_TCNT TCNT2
+#define IR_RX_TIMER_START() IR_TIMER2_START()
+#define IR_RX_TIMER_STOP() IR_TIMER2_STOP()
+#define IR_RX_OVF_VECT TIMER2_OVF_vect
+#define IR_RX_CLKGOV CLKGOV_IR1
+#define IR_RX_CAPTURE 0 // The capture records receiver 0
+#include "libnecdecoder_rx.h"
+#endif
@@ -35,32 +35,83 @@
  // Uncomment this to enable extended NEC protocol support.
  //#define PROTOCOL_NEC_EXTENDED
 
+ // Uncomment this to record the raw pulse widths of the last frames.
+ //#define IR_CAPTURE
 
- //Oi times parakatw antistoixoun gia Favr=16MHZ, Timer_prescaler=1024
- 
- // AGC Burst, 9ms typ, 140.625 clock cycles (typ), +- 0.64ms (10 clocks) typika gia kathe timi
- #define TIME_BURST_MIN 130 
- #define TIME_BURST_MAX 150
+ // Comment this out to drop the decoder health counters.
+ #define IR_STATS
+
+ // Uncomment one of these for a second receiver (ATmega328P only), decoded
+ // at the same time on its own pin with Timer 2 as its timebase. Both feed
+ // ir, a frame seen by both is delivered once. Timer 2 also rules out a
+ // display backend on it and IR_LOOPBACK.
+ //#define IR_RX1_INT1   // INT1 (PD3), not with RTC_DS3231
+ //#define IR_RX1_PCINT0 // PCINT0 (PB0)
+ #if defined(IR_RX1_INT1) || defined(IR_RX1_PCINT0)
+ #define IR_RX1
+ #endif
+
+
+ // Clock the timing windows are derived from
+ #ifndef F_CPU
+ #warning "F_CPU undefined, set to 16MHz"
+ #define F_CPU 16000000UL
+ #endif
+
+ // Timer 0 prescaler: 64, 256 or 1024. Pick one giving ~64us ticks at F_CPU.
+ #ifndef IR_TIMER_PRESCALER
+ #define IR_TIMER_PRESCALER 1024
+ #endif
+
+ // Window tolerance: +- percent of the nominal time plus a fixed receiver jitter
+ #ifndef IR_TOLERANCE_PCT
+ #define IR_TOLERANCE_PCT 10
+ #endif
+ #ifndef IR_JITTER_US
+ #define IR_JITTER_US 150
+ #endif
+
+ // Adaptive timing: clock error (MCU or remote) absorbed by measuring the
+ // AGC burst. Every other window is scaled from the burst of its frame.
+ #ifndef IR_CAL_RANGE_PCT
+ #define IR_CAL_RANGE_PCT 15
+ #endif
+
+ // Timer ticks elapsed after us microseconds (rounded down)
+ #define IR_TICKS(us) ( (uint32_t)(us) * (F_CPU / 1000UL) / ((uint32_t)IR_TIMER_PRESCALER * 1000UL) )
+ // Exclusive window bounds around a nominal time, compared as MIN < cnt < MAX
+ #define IR_WINDOW_MIN_PCT(us, pct) IR_TICKS( (us) - (uint32_t)(us) * (pct) / 100 - IR_JITTER_US )
+ #define IR_WINDOW_MAX_PCT(us, pct) ( IR_TICKS( (us) + (uint32_t)(us) * (pct) / 100 + IR_JITTER_US ) + 1 )
+ #define IR_WINDOW_MIN(us) IR_WINDOW_MIN_PCT( us, IR_TOLERANCE_PCT )
+ #define IR_WINDOW_MAX(us) IR_WINDOW_MAX_PCT( us, IR_TOLERANCE_PCT )
+
+ // AGC Burst, 9ms typ, accepted over the whole calibration range
+ // (16MHz/1024: 140.6 ticks, window 103..179)
+ #define TIME_BURST_MIN IR_WINDOW_MIN_PCT( 9000, IR_TOLERANCE_PCT + IR_CAL_RANGE_PCT )
+ #define TIME_BURST_MAX IR_WINDOW_MAX_PCT( 9000, IR_TOLERANCE_PCT + IR_CAL_RANGE_PCT )
+
+ // The windows below are the nominal ones (exact clock, burst of 9ms), the
+ // decoder recomputes them from each measured burst (see ir_calibrate)
  
- // Gap after AGC Burst, 4.5ms typ, 70.3125 clocks, +- 0.64ms (10 clocks) typika gia kathe timi
- #define TIME_GAP_MIN   60
- #define TIME_GAP_MAX   80
+ // Gap after AGC Burst, 4.5ms typ (70.3 ticks, window 60..80)
+ #define TIME_GAP_MIN   IR_WINDOW_MIN(4500)
+ #define TIME_GAP_MAX   IR_WINDOW_MAX(4500)
 
- // Gap (key hold) after AGC Burst, 2.25ms typ, 35 clokcs, +-0.32 ms (5 cycles) typika gia kathe timi
- #define TIME_HOLD_MIN   30
- #define TIME_HOLD_MAX   40
+ // Gap (key hold) after AGC Burst, 2.25ms typ (35.2 ticks, window 29..42)
+ #define TIME_HOLD_MIN  IR_WINDOW_MIN(2250)
+ #define TIME_HOLD_MAX  IR_WINDOW_MAX(2250)
 
- // Short pulse for each bit, 560us typ, 8.75 cycles, +-0.32ms (5cycles) tipika gia kathe timi
- #define TIME_PULSE_MIN  4
- #define TIME_PULSE_MAX  12
+ // Short pulse for each bit, 560us typ (8.75 ticks, window 5..12)
+ #define TIME_PULSE_MIN IR_WINDOW_MIN(560)
+ #define TIME_PULSE_MAX IR_WINDOW_MAX(560)
  
  // Gap for logical 0, 560us typ
- #define TIME_ZERO_MIN   4
- #define TIME_ZERO_MAX   12
+ #define TIME_ZERO_MIN  IR_WINDOW_MIN(560)
+ #define TIME_ZERO_MAX  IR_WINDOW_MAX(560)
  
- // Gap for logical 1, 1.69ms typ, 26.40 clocks, 8 kyklous katw 12 kyklous panw
- #define TIME_ONE_MIN    18
- #define TIME_ONE_MAX    38
+ // Gap for logical 1, 1.69ms typ (26.4 ticks, window 21..32)
+ #define TIME_ONE_MIN   IR_WINDOW_MIN(1690)
+ #define TIME_ONE_MAX   IR_WINDOW_MAX(1690)
  
  // Definition for state machine 
  enum ir_state_t { IR_BURST, IR_GAP, IR_ADDRESS, IR_ADDRESS_INV, IR_COMMAND, IR_COMMAND_INV };
@@ -70,9 +121,54 @@
  #define IR_KEYHOLD  1 // Key hold
  #define IR_SIGVALID 2 // Valid signal (Internal used)
  
- // Timer Overflows till keyhold flag is cleared
- #define IR_HOLD_OVF 5
+ // Timer Overflows till keyhold flag is cleared (~82ms, 5 at 16MHz/1024)
+ #define IR_HOLD_US  82000UL
+ #define IR_OVF_US   ( 256UL * IR_TIMER_PRESCALER * 1000UL / (F_CPU / 1000UL) )
+ #define IR_HOLD_OVF ( (IR_HOLD_US + IR_OVF_US / 2) / IR_OVF_US )
+
+ // Address filter: maximum number of accepted remote addresses.
+ // An empty filter (count 0) accepts frames from every remote.
+ #define IR_ADDR_FILTER_MAX 4
+
+ // Address type, 16 bits with extended protocol
+ #ifdef PROTOCOL_NEC_EXTENDED
+ typedef uint16_t ir_addr_t;
+ #else
+ typedef uint8_t ir_addr_t;
+ #endif
  
+ // Raw capture: frames kept and pulse widths per frame (AGC burst, gap, 32 bits, stop)
+ #ifndef IR_CAPTURE_FRAMES
+ #define IR_CAPTURE_FRAMES 4
+ #endif
+ #define IR_CAPTURE_EDGES 68
+
+ // Why a captured frame ended
+ enum ir_capture_reason_t { IR_CAP_OK, IR_CAP_HOLD, IR_CAP_WINDOW, IR_CAP_CHECK, IR_CAP_FILTER, IR_CAP_TIMEOUT };
+
+ // Captured frame: edges[] are timer ticks, alternating mark (even) and
+ // space (odd) starting with the AGC burst. state and count tell where the
+ // frame ended and the tick count that ended it (255 after a timeout).
+ struct ir_capture
+  {
+   uint8_t reason;
+   uint8_t state;
+   uint8_t count;
+   uint8_t edges_cnt;
+   uint8_t edges[IR_CAPTURE_EDGES];
+  };
+
+ // Health counters, saturating at 0xFFFF (see ir_statsGet)
+ struct ir_stats_struct
+  {
+   uint16_t frames;    // Frames decoded and delivered
+   uint16_t repeats;   // Key hold repeat codes
+   uint16_t dropped;   // Good frames lost, IR_RECEIVED was still set
+   uint16_t timeouts;  // Frames aborted by a Timer 0 overflow
+   uint16_t filtered;  // Frames of foreign remotes (address filter)
+   uint16_t resets[6]; // Frames abandoned, per ir_state_t they failed in
+  };
+
  // Struct definition
  struct ir_struct
   {
@@ -92,5 +188,14 @@
  // Functions
  void ir_init( void );
  void ir_stop( void );
+ void ir_setAddressFilter( const ir_addr_t *addresses, uint8_t count );
+ #ifdef IR_STATS
+ void ir_statsGet( struct ir_stats_struct *stats, uint8_t clear );
+ #endif
+ #ifdef IR_CAPTURE
+ uint8_t ir_captureGet( uint8_t age, struct ir_capture *frame );
+ void ir_capturePause( uint8_t pause );
+ void ir_captureClear( void );
+ #endif
  
 #endif
\ No newline at end of file
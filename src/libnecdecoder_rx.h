@@ -0,0 +1,374 @@
+// #############################################################################
+// # libnecdecoder_rx.h - Decoder of one receiver, included by libnecdecoder.c #
+// #############################################################################
+//
+// No include guard: libnecdecoder.c includes this once per receiver, after
+// defining the receiver it decodes:
+//   IR_RX               state of the receiver (struct ir_rx)
+//   IR_RX_EDGE_VECT     vector of its input edges
+//   IR_RX_PIN, _BIT     its input pin
+//   IR_RX_TCNT          counter of its timer
+//   IR_RX_TIMER_START() starts the timer at IR_TIMER_PRESCALER
+//   IR_RX_TIMER_STOP()  stops it
+//   IR_RX_OVF_VECT      overflow vector of the timer
+//   IR_RX_CLKGOV        clock governor source held while the timer runs
+//   IR_RX_CAPTURE       1 if this receiver feeds the raw capture
+// Everything resolves to fixed addresses and I/O registers, so every
+// receiver compiles to the same code as a decoder written for its pins.
+// The parameters are undefined at the end, ready for the next receiver.
+
+#if IR_RX_CAPTURE
+#define IR_RX_CAP_BEGIN() ir_cap_begin()
+#define IR_RX_CAP_EDGE(cnt) ir_cap_edge(cnt)
+#define IR_RX_CAP_END(reason, state, cnt) ir_cap_end( reason, state, cnt )
+#else
+#define IR_RX_CAP_BEGIN() ((void)0)
+#define IR_RX_CAP_EDGE(cnt) ((void)0)
+#define IR_RX_CAP_END(reason, state, cnt) ((void)0)
+#endif
+
+// Abandons the frame, the capture keeps why, in which state and the ticks.
+// reason is constant at every use, so only one counter is compiled in.
+#define IR_RX_ABORT(reason) do { \
+	IR_RX_CAP_END( (reason), IR_RX.state, cnt_state ); \
+	if((reason)==IR_CAP_FILTER) IR_STAT(filtered); else IR_STAT(resets[IR_RX.state]); \
+	IR_RX.state = IR_BURST; \
+	} while(0)
+
+
+// ###### Edge of the receiver input ######
+ISR( IR_RX_EDGE_VECT )
+{
+	RAMSTAT_ISR_ENTER();
+	// Get current port state to check if we triggered on rising or falling edge
+	uint8_t port_state = ( IR_RX_PIN & (1<<IR_RX_BIT) );
+	uint8_t cnt_state = IR_RX_TCNT;
+
+	if(IR_RX.ovf!=0)
+	{
+		// Overflow or timer idle, so reset, (re)start timer and ignore.
+		IR_RX_CAP_END( IR_CAP_TIMEOUT, IR_RX.state, 255 ); // Frame in progress timed out
+		if(IR_RX.state!=IR_BURST) IR_STAT(timeouts);
+		IR_RX.ovf = 0;
+		IR_RX.state = IR_BURST;
+		clkgov_request(IR_RX_CLKGOV); // Full speed while the timer runs
+		IR_RX_TCNT = 0;
+		IR_RX_TIMER_START();
+		if(!port_state) IR_RX_CAP_BEGIN();
+		RAMSTAT_ISR_EXIT();
+		return;
+	}
+
+	IR_RX_CAP_EDGE(cnt_state);
+
+	switch(IR_RX.state)
+	{
+		case IR_BURST:
+		if(!port_state)
+		{
+			IR_RX_TCNT = 0; // Reset counter
+			IR_RX_CAP_BEGIN();
+			} else {
+			if((cnt_state>TIME_BURST_MIN)&&(cnt_state<TIME_BURST_MAX))
+			{
+				IR_RX.state = IR_GAP; // Next state
+				IR_RX_TCNT = 0; // Reset counter
+				ir_calibrate(&IR_RX, cnt_state);
+			} else
+			if(cnt_state>=TIME_PULSE_MAX)
+			{
+				IR_RX_ABORT(IR_CAP_WINDOW); // Shorter marks are stop bits
+			}
+		}
+		break;
+		case IR_GAP:
+		if(!port_state)
+		{
+			if((cnt_state>IR_RX.win.gap_min)&&(cnt_state<IR_RX.win.gap_max))
+			{
+				IR_RX_TCNT = 0; // Reset counter
+				IR_RX.state = IR_ADDRESS; // Next state
+				IR_RX.bitctr = 0; // Reset bitcounter
+				ir.status &= ~(1<<IR_KEYHOLD);
+				break;
+			} else
+			if((cnt_state>IR_RX.win.hold_min)&&(cnt_state<IR_RX.win.hold_max))
+			{
+				if(ir.status & (1<<IR_SIGVALID))
+				{
+					ir.status |= (1<<IR_KEYHOLD);
+					IR_RX.keyhold = IR_HOLD_OVF;
+				}
+				IR_RX_CAP_END( IR_CAP_HOLD, IR_GAP, cnt_state );
+				IR_STAT(repeats);
+				IR_RX.state = IR_BURST;
+				break;
+			}
+		}
+		// Should not happen, must be invalid. Reset.
+		IR_RX_ABORT(IR_CAP_WINDOW);
+		break;
+		case IR_ADDRESS:
+		if(port_state)
+		{
+			// Must be short pulse
+			if((cnt_state>IR_RX.win.pulse_min)&&(cnt_state<IR_RX.win.pulse_max))
+			{
+				IR_RX_TCNT = 0; // Reset counter
+				IR_RX.mark_sum += cnt_state;
+				break;
+			}
+			// Should not happen, must be invalid. Reset.
+			IR_RX_ABORT(IR_CAP_WINDOW);
+			} else {
+			if((cnt_state>IR_RX.win.zero_min)&&(cnt_state<IR_RX.win.zero_max))
+			{
+				// 0
+				#ifdef PROTOCOL_NEC_EXTENDED
+				IR_RX.address_l &= ~(1<<IR_RX.bitctr++);
+				#else
+				IR_RX.address &= ~(1<<IR_RX.bitctr++);
+				#endif
+				IR_RX_TCNT = 0; // Reset counter
+				if(IR_RX.bitctr>=8)
+				{
+					IR_RX.state = IR_ADDRESS_INV; // Next state
+					IR_RX.bitctr = 0; // Reset bitcounter
+					#ifndef PROTOCOL_NEC_EXTENDED
+					// Foreign remote, abandon frame early
+					if(!ir_addr_accept(&IR_RX, IR_RX.address)) IR_RX_ABORT(IR_CAP_FILTER);
+					#endif
+				}
+				break;
+			} else
+			if((cnt_state>IR_RX.win.one_min)&&(cnt_state<IR_RX.win.one_max))
+			{
+				// 1
+				#ifdef PROTOCOL_NEC_EXTENDED
+				IR_RX.address_l |= (1<<IR_RX.bitctr++);
+				#else
+				IR_RX.address |= (1<<IR_RX.bitctr++);
+				#endif
+				IR_RX_TCNT = 0; // Reset counter
+				if(IR_RX.bitctr>=8)
+				{
+					IR_RX.state = IR_ADDRESS_INV; // Next state
+					IR_RX.bitctr = 0; // Reset bitcounter
+					#ifndef PROTOCOL_NEC_EXTENDED
+					// Foreign remote, abandon frame early
+					if(!ir_addr_accept(&IR_RX, IR_RX.address)) IR_RX_ABORT(IR_CAP_FILTER);
+					#endif
+				}
+				break;
+			}
+			// Should not happen, must be invalid. Reset.
+			IR_RX_ABORT(IR_CAP_WINDOW);
+			break;
+		}
+		break;
+		case IR_ADDRESS_INV:
+		if(port_state)
+		{
+			// Must be short pulse
+			if((cnt_state>IR_RX.win.pulse_min)&&(cnt_state<IR_RX.win.pulse_max))
+			{
+				IR_RX_TCNT = 0; // Reset counter
+				IR_RX.mark_sum += cnt_state;
+				break;
+			}
+			// Should not happen, must be invalid. Reset.
+			IR_RX_ABORT(IR_CAP_WINDOW);
+			} else {
+			if((cnt_state>IR_RX.win.zero_min)&&(cnt_state<IR_RX.win.zero_max))
+			{
+				// 0 (inverted) or high address
+				#ifdef PROTOCOL_NEC_EXTENDED
+				IR_RX.address_h &= ~(1<<IR_RX.bitctr++);
+				#else
+				if(!(IR_RX.address&(1<<IR_RX.bitctr++)))
+				{
+					// Should not happen, must be invalid. Reset.
+					IR_RX_ABORT(IR_CAP_CHECK);
+					break;
+				}
+				#endif
+				IR_RX_TCNT = 0; // Reset counter
+				if(IR_RX.bitctr>=8)
+				{
+					IR_RX.state = IR_COMMAND; // Next state
+					IR_RX.bitctr = 0; // Reset bitcounter
+					#ifdef PROTOCOL_NEC_EXTENDED
+					// Foreign remote, abandon frame early
+					if(!ir_addr_accept(&IR_RX, ((ir_addr_t)IR_RX.address_h<<8)|IR_RX.address_l)) IR_RX_ABORT(IR_CAP_FILTER);
+					#endif
+				}
+				break;
+			} else
+			if((cnt_state>IR_RX.win.one_min)&&(cnt_state<IR_RX.win.one_max))
+			{
+				// 1 (inverted) or high address
+				#ifdef PROTOCOL_NEC_EXTENDED
+				IR_RX.address_h |= (1<<IR_RX.bitctr++);
+				#else
+				if(IR_RX.address&(1<<IR_RX.bitctr++))
+				{
+					// Should not happen, must be invalid. Reset.
+					IR_RX_ABORT(IR_CAP_CHECK);
+					break;
+				}
+				#endif
+				IR_RX_TCNT = 0; // Reset counter
+				if(IR_RX.bitctr>=8)
+				{
+					IR_RX.state = IR_COMMAND; // Next state
+					IR_RX.bitctr = 0; // Reset bitcounter
+					#ifdef PROTOCOL_NEC_EXTENDED
+					// Foreign remote, abandon frame early
+					if(!ir_addr_accept(&IR_RX, ((ir_addr_t)IR_RX.address_h<<8)|IR_RX.address_l)) IR_RX_ABORT(IR_CAP_FILTER);
+					#endif
+				}
+				break;
+			}
+			// Should not happen, must be invalid. Reset.
+			IR_RX_ABORT(IR_CAP_WINDOW);
+			break;
+		}
+		break;
+		case IR_COMMAND:
+		if(port_state)
+		{
+			// Must be short pulse
+			if((cnt_state>IR_RX.win.pulse_min)&&(cnt_state<IR_RX.win.pulse_max))
+			{
+				IR_RX_TCNT = 0; // Reset counter
+				IR_RX.mark_sum += cnt_state;
+				break;
+			}
+			// Should not happen, must be invalid. Reset.
+			IR_RX_ABORT(IR_CAP_WINDOW);
+			} else {
+			if((cnt_state>IR_RX.win.zero_min)&&(cnt_state<IR_RX.win.zero_max))
+			{
+				// 0
+				IR_RX.command &= ~(1<<IR_RX.bitctr++);
+				IR_RX_TCNT = 0; // Reset counter
+				if(IR_RX.bitctr>=8)
+				{
+					IR_RX.state = IR_COMMAND_INV; // Next state
+					IR_RX.bitctr = 0; // Reset bitcounter
+				}
+				break;
+			} else
+			if((cnt_state>IR_RX.win.one_min)&&(cnt_state<IR_RX.win.one_max))
+			{
+				// 1
+				IR_RX.command |= (1<<IR_RX.bitctr++);
+				IR_RX_TCNT = 0; // Reset counter
+				if(IR_RX.bitctr>=8)
+				{
+					IR_RX.state = IR_COMMAND_INV; // Next state
+					IR_RX.bitctr = 0; // Reset bitcounter
+				}
+				break;
+			}
+			// Should not happen, must be invalid. Reset.
+			IR_RX_ABORT(IR_CAP_WINDOW);
+			break;
+		}
+		break;
+		case IR_COMMAND_INV:
+		if(port_state)
+		{
+			// Must be short pulse
+			if((cnt_state>IR_RX.win.pulse_min)&&(cnt_state<IR_RX.win.pulse_max))
+			{
+				IR_RX_TCNT = 0; // Reset counter
+				IR_RX.mark_sum += cnt_state;
+				break;
+			}
+			// Should not happen, must be invalid. Reset.
+			IR_RX_ABORT(IR_CAP_WINDOW);
+			} else {
+			if((cnt_state>IR_RX.win.zero_min)&&(cnt_state<IR_RX.win.zero_max))
+			{
+				// 0 (inverted)
+				if(!(IR_RX.command&(1<<IR_RX.bitctr++)))
+				{
+					// Should not happen, must be invalid. Reset.
+					IR_RX_ABORT(IR_CAP_CHECK);
+					break;
+				}
+				IR_RX_TCNT = 0; // Reset counter
+				if(IR_RX.bitctr>=8)
+				{
+					IR_RX_CAP_END( IR_CAP_OK, IR_COMMAND_INV, cnt_state );
+					ir_cal_learn(&IR_RX);
+					IR_RX.state = IR_BURST; // Decoding finished.
+					ir_deliver(&IR_RX);
+					IR_RX.bitctr = 0; // Reset bitcounter
+				}
+				break;
+			} else
+			if((cnt_state>IR_RX.win.one_min)&&(cnt_state<IR_RX.win.one_max))
+			{
+				// 1 (inverted)
+				if(IR_RX.command&(1<<IR_RX.bitctr++))
+				{
+					// Should not happen, must be invalid. Reset.
+					IR_RX_ABORT(IR_CAP_CHECK);
+					break;
+				}
+				IR_RX_TCNT = 0; // Reset counter
+				if(IR_RX.bitctr>=8)
+				{
+					IR_RX_CAP_END( IR_CAP_OK, IR_COMMAND_INV, cnt_state );
+					ir_cal_learn(&IR_RX);
+					IR_RX.state = IR_BURST; // Decoding finished.
+					ir_deliver(&IR_RX);
+					IR_RX.bitctr = 0; // Reset bitcounter
+				}
+				break;
+			}
+			// Should not happen, must be invalid. Reset.
+			IR_RX_ABORT(IR_CAP_WINDOW);
+			break;
+		}
+		break;
+	}
+	RAMSTAT_ISR_EXIT();
+}
+
+
+// ###### Timer overflow for hold flag clear and idle stop ######
+ISR( IR_RX_OVF_VECT )
+{
+	RAMSTAT_ISR_ENTER();
+	IR_RX.ovf = 1;
+	if(IR_RX.keyhold>0)
+	{
+		IR_RX.keyhold--;
+		if(IR_KEYHOLD_OVER()) ir.status &= ~((1<<IR_KEYHOLD) | (1<<IR_SIGVALID));
+	}
+	// Nothing left to time, stop until the next edge
+	if(IR_RX.keyhold==0)
+	{
+		IR_RX_TIMER_STOP();
+		clkgov_release(IR_RX_CLKGOV);
+	}
+	RAMSTAT_ISR_EXIT();
+}
+
+#undef IR_RX_CAP_BEGIN
+#undef IR_RX_CAP_EDGE
+#undef IR_RX_CAP_END
+#undef IR_RX_ABORT
+#undef IR_RX
+#undef IR_RX_EDGE_VECT
+#undef IR_RX_PIN
+#undef IR_RX_BIT
+#undef IR_RX_TCNT
+#undef IR_RX_TIMER_START
+#undef IR_RX_TIMER_STOP
+#undef IR_RX_OVF_VECT
+#undef IR_RX_CLKGOV
+#undef IR_RX_CAPTURE
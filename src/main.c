@@ -1,532 +1,2398 @@
-/*
- * 24H Remote Alarm with Display.c
- * 
- * Created: 20/10/2016 7:10:35 μμ
- * Author : Tasos Kakouris
- 
- * Real 24H Clock with Segment Display (+MAX7219)
- * Clock is setted by IR remote.
- * Timer1 is used for ticking
- */
-#define F_CPU 16000000UL
-#include <avr/io.h>
-#include "main.h"
-#include "MAX7219.h"
-#include "libnecdecoder.h"
-#include <avr/interrupt.h>
-#include <util/delay.h>
-
-/* Global variables */
-volatile uint8_t digitPtr;
-volatile int8_t clockDigits[4] = {0, 0, 0, 0};
-volatile uint8_t tim1_cnt_compa = 0, clockDisplayFlag = 1;
-
-volatile int8_t alarmDigits[4] = {0, 0, 0, 0};
-volatile uint8_t alarmPtr, alarmSetFlag = 0, buzzerActivateFlag = 0;
-
-/*
- * Interrupt Service Routine, TIMER1_COMPA_vect
- * --------------------------------------------
- * Called every 1 sec to update timer
- */
-ISR(TIMER1_COMPA_vect)
-{
-	/* Update count */
-	tim1_cnt_compa++;
-	if (tim1_cnt_compa == 60)
-	{
-		tim1_cnt_compa = 0;
-		clockDigits[3]++;
-		if (clockDigits[3] > 9)
-		{
-			clockDigits[3] = 0;
-			clockDigits[2]++;
-			if (clockDigits[2] > 5)
-			{
-				clockDigits[2] = 0;
-				clockDigits[1]++;
-				if (clockDigits[0] < 2 && clockDigits[1] > 9)
-				{
-					clockDigits[1] = 0;
-					clockDigits[0]++;
-				}
-				else if (clockDigits[0] == 2 && clockDigits[1] > 3)
-				{
-					clockDigits[1] = 0;
-					clockDigits[0] = 0;
-				}
-			}
-		}
-
-		/* Update display */
-		if (clockDisplayFlag)
-			clockUpdateDisplay();
-
-		/* Check for alarm */
-		if (alarmSetFlag)
-		{
-			if ((alarmDigits[0] == clockDigits[0]) && (alarmDigits[1] == clockDigits[1]) && (alarmDigits[2] == clockDigits[2]) && (alarmDigits[3] == clockDigits[3]))
-			{
-				buzzerActivateFlag = 1;
-				alarmSetFlag = 0;
-			}
-		}
-	}
-}
-
-int main(void)
-{
-	MAX7219_init();
-	MAX7219_decodeMode(2);
-	ir_init();
-	user_setTime(); // blocking function
-	timer1_init();  // start timer...
-
-	// Loop forever until user presses Play/Pause button
-	IR_receive_mask_clear;
-	while (1)
-	{
-		if (IR_receive_mask)
-		{
-			uint8_t check_val = ir.command;
-			IR_receive_mask_clear;
-			if (check_val == SET_ALARM_IRcommand)
-			{
-				clockDisplayFlag = 0; // Dont show real clock until user set alarm
-				user_setAlarm();	  // mode button pressed, blocking function
-				clockDisplayFlag = 1;
-				alarmSetFlag = 1;
-				IR_receive_mask_clear;
-				clockUpdateDisplay();
-				continue;
-			}
-		}
-		if (buzzerActivateFlag)
-		{
-			alarmBuzzer_activate();
-			alarmSetFlag = 0;
-		}
-	}
-}
-
-/**
- * Function: timer1_init
- * ---------------------
- * Initializes and starts Timer1 with settings:
- * 		CTC Mode, Compare Interrupt Enabled
- * 		Prescaler = 256
- * 		OCR1 = 62500
- * 
- */
-void timer1_init(void)
-{
-	TCCR1A = 0;
-	TCCR1B = 0b00001100;
-	OCR1AH = HIGH(62500);
-	OCR1AL = LOW(62500);
-	TCNT1H = 0;
-	TCNT1L = 0;
-	TIMSK1 = 2;
-	sei();
-	clockUpdateDisplay();
-	return;
-}
-
-/**
- * Function: user_setTime
- * ---------------------
- * User sets time with remote controller
- * 
- */
-void user_setTime(void)
-{
-	MAX7219_setDigitNum(1, 0);
-	MAX7219_setDigitNum(2, 0);
-	MAX7219_setDigitNum(3, 0);
-	MAX7219_setDigitNum(4, 0);
-	uint8_t IRcommand = 0;
-	while (1)
-	{
-		if ((IR_receive_mask == 0) && (IR_hold_mask == 0))
-			continue;
-		if ((IR_receive_mask == 1) && (IR_hold_mask == 0))
-		{
-			IRcommand = ir.command;
-			IR_receive_mask_clear;
-		}
-		switch (IRcommand)
-		{
-		case INC_DIGIT_IRcommand:
-			clockControl_incDigit();
-			break;
-		case DEC_DIGIT_IRcommand:
-			clockControl_decDigit();
-			break;
-		case INC_DIGIT_NUM_IRcommand:
-			clockControl_incDigitNum();
-			break;
-		case DEC_DIGIT_NUM_IRcommand:
-			clockControl_decDigitNum();
-			break;
-		case CLOCK_DONE_IRcommmand:
-			return;
-		}
-		_delay_ms(200); // safety blocking till IR correct receive
-	}
-	return;
-}
-
-/**
- * Function: clockControl_incDigit
- * ---------------------
- * Increases clock digit to the right
- * 
- */
-void clockControl_incDigit(void)
-{
-	MAX7219_setDigitNum(digitPtr + 1, clockDigits[digitPtr]); //remove dot (.)
-	digitPtr++;
-	if (digitPtr > 3)
-		digitPtr = 0;
-	MAX7219_setDigitNum(digitPtr + 1, clockDigits[digitPtr] | 0b10000000); //add dot (.)
-	return;
-}
-
-/**
- * Function: clockControl_decDigit
- * ---------------------
- * Decrease clock digit to the right
- * 
- */
-void clockControl_decDigit(void)
-{
-	MAX7219_setDigitNum(digitPtr + 1, clockDigits[digitPtr]); //remove dot (.)
-	digitPtr--;
-	if (digitPtr > 3)
-		digitPtr = 3;
-	MAX7219_setDigitNum(digitPtr + 1, clockDigits[digitPtr] | 0b10000000); //add dot (.)
-	return;
-}
-
-/**
- * Function: clockControl_incDigitNum
- * ---------------------
- * Increase clock digit num
- * 
- */
-void clockControl_incDigitNum(void)
-{
-	clockDigits[digitPtr]++;
-	switch (digitPtr)
-	{
-	case 0:
-		if (clockDigits[0] > 2)
-			clockDigits[0] = 0;
-		if (clockDigits[0] == 2)
-		{
-			if (clockDigits[1] > 3)
-				clockDigits[1] = 0;
-			MAX7219_setDigitNum(2, 0);
-		}
-		break;
-	case 1:
-		if (clockDigits[0] < 2)
-		{
-			if (clockDigits[1] > 9)
-				clockDigits[1] = 0;
-		}
-		else if (clockDigits[0] == 2)
-		{
-			if ((clockDigits[1]) > 3)
-				clockDigits[1] = 0;
-		}
-		break;
-	case 2:
-		if (clockDigits[2] > 5)
-			clockDigits[2] = 0;
-		break;
-	case 3:
-		if (clockDigits[3] > 9)
-			clockDigits[3] = 0;
-		break;
-	}
-	/* Update display */
-	MAX7219_setDigitNum(digitPtr + 1, clockDigits[digitPtr] | 0b10000000); //add dot (.)
-	return;
-}
-
-/**
- * Function: clockControl_decDigitNum
- * ---------------------
- * Decrease clock digit num
- * 
- */
-void clockControl_decDigitNum(void)
-{
-	clockDigits[digitPtr]--;
-	switch (digitPtr)
-	{
-	case 0:
-		if (clockDigits[0] < 0)
-			clockDigits[0] = 2;
-		if (clockDigits[0] == 2)
-		{
-			if (clockDigits[1] > 3)
-				clockDigits[1] = 0;
-			MAX7219_setDigitNum(2, 0);
-		}
-		break;
-	case 1:
-		if (clockDigits[0] < 2)
-		{
-			if (clockDigits[1] < 0)
-				clockDigits[1] = 9;
-		}
-		else if (clockDigits[0] == 2)
-		{
-			if ((clockDigits[1]) < 0)
-				clockDigits[1] = 3;
-		}
-		break;
-	case 2:
-		if (clockDigits[2] < 0)
-			clockDigits[2] = 5;
-		break;
-	case 3:
-		if (clockDigits[3] < 0)
-			clockDigits[3] = 9;
-		break;
-	}
-	/* Update display */
-	MAX7219_setDigitNum(digitPtr + 1, clockDigits[digitPtr] | 0b10000000); //add dot (.)
-	return;
-}
-
-/**
- * Function: clockUpdateDisplay
- * ---------------------
- * Updates the display with the correct format: XX.XX
- * 
- */
-void clockUpdateDisplay(void)
-{
-	MAX7219_setDigitNum(4, clockDigits[3]);
-	MAX7219_setDigitNum(3, clockDigits[2]);
-	MAX7219_setDigitNum(2, clockDigits[1] | 0b10000000); //dot in middle
-	MAX7219_setDigitNum(1, clockDigits[0]);
-	return;
-}
-
-/**
- * Function: user_setAlarm
- * ---------------------
- * User sets alarm time
- * 
- */
-void user_setAlarm(void)
-{
-	/*Initialize Alarm digits*/
-	alarmDigits[0] = 0;
-	alarmDigits[1] = 0;
-	alarmDigits[2] = 0;
-	alarmDigits[3] = 0;
-
-	/*Initialize display with zeros so User will set alarm */
-	MAX7219_set4digitNum(0);
-
-	/*User alarm button interface same as clock*/
-	uint8_t IRcommand = 0;
-
-	while (1)
-	{
-		if ((IR_receive_mask == 0) && (IR_hold_mask == 0))
-			continue;
-		if ((IR_receive_mask == 1) && (IR_hold_mask == 0))
-		{
-			IRcommand = ir.command;
-			IR_receive_mask_clear;
-		}
-		switch (IRcommand)
-		{
-		case INC_DIGIT_IRcommand:
-			alarmControl_incDigit();
-			break;
-		case DEC_DIGIT_IRcommand:
-			alarmControl_decDigit();
-			break;
-		case INC_DIGIT_NUM_IRcommand:
-			alarmControl_incDigitNum();
-			break;
-		case DEC_DIGIT_NUM_IRcommand:
-			alarmControl_decDigitNum();
-			break;
-		case CLOCK_DONE_IRcommmand:
-			return;
-		}
-		_delay_ms(200); //safety blocking till IR correct receive
-	}
-	return;
-}
-
-/**
- * Function: alarmControl_incDigit
- * ---------------------
- * Increases alarm clock digit to the right
- * 
- */
-void alarmControl_incDigit(void)
-{
-	MAX7219_setDigitNum(alarmPtr + 1, alarmDigits[alarmPtr]); //remove dot (.)
-	alarmPtr++;
-	if (alarmPtr > 3)
-		alarmPtr = 0;
-	MAX7219_setDigitNum(alarmPtr + 1, alarmDigits[alarmPtr] | 0b10000000); //add dot (.)
-	return;
-}
-
-/**
- * Function: alarmControl_decDigit
- * ---------------------
- * Decreases alarm clock digit to the right
- * 
- */
-void alarmControl_decDigit(void)
-{
-	MAX7219_setDigitNum(alarmPtr + 1, alarmDigits[alarmPtr]); //remove dot (.)
-	alarmPtr--;
-	if (alarmPtr > 3)
-		alarmPtr = 3;
-	MAX7219_setDigitNum(alarmPtr + 1, alarmDigits[alarmPtr] | 0b10000000); //add dot (.)
-	return;
-}
-
-/**
- * Function: alarmControl_incDigitNum
- * ---------------------
- * Increases alarm clock digit
- * 
- */
-void alarmControl_incDigitNum(void)
-{
-	alarmDigits[alarmPtr]++;
-	switch (alarmPtr)
-	{
-	case 0:
-		if (alarmDigits[0] > 2)
-			alarmDigits[0] = 0;
-		if (alarmDigits[0] == 2)
-		{
-			if (alarmDigits[1] > 3)
-				alarmDigits[1] = 0;
-			MAX7219_setDigitNum(2, 0);
-		}
-		break;
-	case 1:
-		if (alarmDigits[0] < 2)
-		{
-			if (alarmDigits[1] > 9)
-				alarmDigits[1] = 0;
-		}
-		else if (alarmDigits[0] == 2)
-		{
-			if ((alarmDigits[1]) > 3)
-				alarmDigits[1] = 0;
-		}
-		break;
-	case 2:
-		if (alarmDigits[2] > 5)
-			alarmDigits[2] = 0;
-		break;
-	case 3:
-		if (alarmDigits[3] > 9)
-			alarmDigits[3] = 0;
-		break;
-	}
-
-	/* Update display */
-	MAX7219_setDigitNum(alarmPtr + 1, alarmDigits[alarmPtr] | 0b10000000); //add dot (.)
-	return;
-}
-
-/**
- * Function: alarmControl_decDigitNum
- * ---------------------
- * Decreases alarm clock digit
- * 
- */
-void alarmControl_decDigitNum(void)
-{
-	alarmDigits[alarmPtr]--;
-	switch (alarmPtr)
-	{
-	case 0:
-		if (alarmDigits[0] < 0)
-			alarmDigits[0] = 2;
-		if (alarmDigits[0] == 2)
-		{
-			if (alarmDigits[1] > 3)
-				alarmDigits[1] = 0;
-			MAX7219_setDigitNum(2, 0);
-		}
-		break;
-	case 1:
-		if (alarmDigits[0] < 2)
-		{
-			if (alarmDigits[1] < 0)
-				alarmDigits[1] = 9;
-		}
-		else if (alarmDigits[0] == 2)
-		{
-			if ((alarmDigits[1]) < 0)
-				alarmDigits[1] = 3;
-		}
-		break;
-	case 2:
-		if (alarmDigits[2] < 0)
-			alarmDigits[2] = 5;
-		break;
-	case 3:
-		if (alarmDigits[3] < 0)
-			alarmDigits[3] = 9;
-		break;
-	}
-
-	/* Update display */
-	MAX7219_setDigitNum(alarmPtr + 1, alarmDigits[alarmPtr] | 0b10000000); //add dot (.)
-	return;
-}
-
-/**
- * Function: alarmControl_decDigitNum
- * ---------------------
- * Activates buzzer for 10 seconds until user presses off
- * 
- */
-void alarmBuzzer_activate(void)
-{
-	clockDisplayFlag = 0;
-	BUZZER_ddr |= (1 << BUZZER_bit);
-	BUZZER_port |= (1 << BUZZER_bit);
-	IR_receive_mask_clear;
-	for (int i = 0; i < 100; i++)
-	{
-		if (IR_receive_mask)
-		{
-			uint8_t check_val = ir.command;
-			IR_receive_mask_clear;
-			/* Check to turn off buzzer */
-			if (check_val == ALARM_OFF_IRcommand)
-				break;
-		}
-		/* 10 seconds delay total, unless user presses OFF to turn off buzzer */
-		_delay_ms(100);
-	}
-
-	/*Turn off buzzer */
-	BUZZER_port &= ~(1 << BUZZER_bit);
-	clockDisplayFlag = 1;
-	buzzerActivateFlag = 0;
-	_delay_ms(200); //safety
-
-	return;
-}
+/*
+ * 24H Remote Alarm with Display.c
+ * 
+ * Created: 20/10/2016 7:10:35 μμ
+ * Author : Tasos Kakouris
+ 
+ * Real 24H Clock with Segment Display (+MAX7219)
+ * Clock is setted by IR remote.
+ * Timer1 is used for ticking (tickless, interrupts at the next deadline)
+ */
+#define F_CPU 16000000UL
+#include <avr/io.h>
+#include "main.h"
+#include "display.h"
+#include "libnecdecoder.h"
+#include "clockgov.h"
+#include "timerwheel.h"
+#include "ramstat.h"
+#include "keymap.h"
+#include "ds3231.h"
+#include "irtx.h"
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/wdt.h>
+#include <avr/sleep.h>
+
+_Static_assert(F_CPU % TIMER1_PRESCALER == 0, "Timer1 tick must be a whole number of Hz");
+_Static_assert(TW_TICK_HZ % STOPWATCH_REFRESH_HZ == 0, "Stopwatch refresh must be a whole number of wheel ticks");
+
+/* Global variables */
+volatile uint8_t digitPtr;
+volatile int8_t timeDigits[4]; // time entry: edited copy of the time
+uint8_t timeWeekday; // time entry: edited copy of the weekday
+uint8_t timeEntryStage = TIME_ENTRY_OFF;
+uint8_t timeEntryKey; // last key, repeated while held
+uint8_t timeEntryCommit; // 0 drops the entered time
+volatile int8_t clockDigits[4] = {0, 0, 0, 0};
+volatile uint8_t clockSeq; // bumped on every minute rollover
+volatile uint32_t clockMinuteStart; // tick count the current minute started at
+uint32_t idleTicks; // Timer1 ticks slept in user_idle, for the load meter
+
+volatile uint16_t tim1_ovf;		 // high word of the Timer1 tick count
+volatile uint32_t tim1_deadline; // tick count of the next compare interrupt
+
+volatile uint8_t clockWeekday = 0; // 0 = day 1 ... 6 = day 7
+#ifdef RTC_DS3231
+volatile uint8_t clockSeconds;		// seconds, counted by the RTC SQW
+uint8_t rtcPresent;					// RTC ticks the clock, else Timer1
+volatile uint8_t rtcStatus;			// enum ds3231_status of the last boot transfer
+#define RTC_PENDING 0xFF
+#endif
+uint8_t clockShown[CLOCK_DIGITS] = {[0 ... CLOCK_DIGITS - 1] = 0xFF}; // digits on the display
+
+volatile int8_t alarmDigits[4] = {0, 0, 0, 0}; // edited alarm
+volatile uint8_t alarmPtr;
+volatile struct alarm_struct alarms[ALARM_COUNT];
+volatile uint16_t alarmNextTime; // packed HHMM of the next alarm today
+volatile uint8_t alarmNextSlot;
+
+/* Software timers (timerwheel.c) */
+struct tw_timer keyRepeatTimer; // key repeat and debounce interval
+struct tw_timer displayTimer;	// delays the return to the clock
+struct tw_timer buzzerTimer;	// alarm sound duration
+struct tw_timer refreshTimer;	// stopwatch display refresh
+#ifdef POWERFAIL_ENABLE
+struct tw_timer powerfailTimer; // comparator start-up
+#endif
+#ifdef RTC_DS3231
+struct tw_timer rtcTimer; // aborts a stuck hourly read
+#endif
+
+/* EEPROM: learned remote addresses (count 0xFF = erased, accept all) */
+uint8_t EEMEM ee_remoteCount;
+ir_addr_t EEMEM ee_remoteAddr[IR_ADDR_FILTER_MAX];
+
+#ifdef IR_LOOPBACK
+/* Loopback self-test: keys sent to the time editor, key to display latencies */
+static const uint8_t loopbackKeys[] = {KEY_INC_DIGIT_NUM, KEY_INC_DIGIT, KEY_DEC_DIGIT_NUM, KEY_DEC_DIGIT};
+#define LOOPBACK_KEYS sizeof(loopbackKeys)
+uint16_t loopbackTicks[LOOPBACK_KEYS][LOOPBACK_ROUNDS]; // Timer1 ticks per key and round
+uint8_t loopbackSent;									// frames sent so far
+ir_addr_t loopbackAddress;								// accepted by the address filter
+struct tw_timer loopbackTimer;							// paces the frames
+#endif
+
+#ifdef POWERFAIL_ENABLE
+/* EEPROM: state at the last power fail, longest save seen (Timer1 ticks) */
+struct powerfail_struct EEMEM ee_powerfail;
+uint16_t EEMEM ee_powerfailMaxTicks;
+#endif
+
+/* Survives resets other than power-on, validated by checksum */
+struct resume_struct resumeState __attribute__((section(".noinit")));
+uint8_t mcusr_mirror __attribute__((section(".noinit")));
+
+/*
+ * Function: get_mcusr
+ * -------------------
+ * Runs before main (.init3): saves the reset cause and stops the watchdog,
+ * which stays enabled after a watchdog reset.
+ */
+void get_mcusr(void) __attribute__((naked)) __attribute__((used)) __attribute__((section(".init3")));
+void get_mcusr(void)
+{
+	mcusr_mirror = MCUSR;
+	MCUSR = 0;
+	wdt_disable();
+}
+
+/*
+ * Function: clock_pack
+ * --------------------
+ * Packs four time digits into one comparable 16 bit value (0xHHMM)
+ */
+static inline uint16_t clock_pack(const volatile int8_t *digits)
+{
+	return ((uint16_t)digits[0] << 12) | ((uint16_t)digits[1] << 8) | (digits[2] << 4) | digits[3];
+}
+
+/*
+ * Function: clock_unpack
+ * ----------------------
+ * Splits a packed time (clock_pack) back into four digits
+ */
+static inline void clock_unpack(uint16_t packed, volatile int8_t *digits)
+{
+	for (int8_t i = 3; i >= 0; i--)
+	{
+		digits[i] = packed & 0x0F;
+		packed >>= 4;
+	}
+	return;
+}
+
+/*
+ * Function: timer1_nowLocked
+ * --------------------------
+ * Current Timer1 tick count, interrupts must be disabled.
+ * An overflow that is pending but not yet counted is accounted for.
+ */
+static uint32_t timer1_nowLocked(void)
+{
+	uint16_t lo = TCNT1, hi = tim1_ovf;
+	if ((TIFR1 & (1 << TOV1)) && (lo < 0x8000))
+		hi++;
+	return ((uint32_t)hi << 16) | lo;
+}
+
+/*
+ * Function: timer1_arm
+ * --------------------
+ * Programs OCR1A for tim1_deadline if it falls before the next
+ * 16 bit wrap, otherwise the overflow ISR arms it later.
+ * Deadlines closer than TIMER1_MARGIN fire TIMER1_MARGIN ticks from now.
+ * Interrupts must be disabled.
+ */
+static void timer1_arm(void)
+{
+	uint32_t now = timer1_nowLocked();
+	int32_t left = (int32_t)(tim1_deadline - now);
+	if (left < TIMER1_MARGIN)
+	{
+		OCR1A = (uint16_t)now + TIMER1_MARGIN;
+	}
+	else if (left <= 0xFFFF)
+	{
+		OCR1A = (uint16_t)tim1_deadline;
+	}
+	else
+	{
+		TIMSK1 &= ~(1 << OCIE1A);
+		return;
+	}
+	TIFR1 = (1 << OCF1A);
+	TIMSK1 |= (1 << OCIE1A);
+	return;
+}
+
+/*
+ * Function: clock_arm
+ * -------------------
+ * Sets the deadline to the next rollover of the minute started at
+ * clockMinuteStart (next second with CLOCK_DIGITS 8) and arms it.
+ * Interrupts must be disabled.
+ */
+static void clock_arm(void)
+{
+#if CLOCK_DIGITS == 8
+	tim1_deadline = clockMinuteStart + ((timer1_nowLocked() - clockMinuteStart) / TIMER1_HZ + 1) * TIMER1_HZ;
+#else
+	tim1_deadline = clockMinuteStart + TIMER1_TICKS_PER_MIN;
+#endif
+	timer1_arm();
+	return;
+}
+
+/*
+ * Interrupt Service Routine, TIMER1_OVF_vect
+ * ------------------------------------------
+ * Called every 65536 ticks (4.2 sec) to extend the tick count
+ */
+ISR(TIMER1_OVF_vect)
+{
+	RAMSTAT_ISR_ENTER();
+	tim1_ovf++;
+#ifdef RTC_DS3231
+	if (!rtcPresent) // the SQW ticks, no deadline
+#endif
+		timer1_arm();
+
+	/* Mirror state for warm restart */
+	resume_save();
+	RAMSTAT_ISR_EXIT();
+}
+
+/*
+ * Interrupt Service Routine, TIMER1_COMPA_vect
+ * --------------------------------------------
+ * Called at the next deadline: the minute rollover, or every second
+ * when seconds are shown (CLOCK_DIGITS 8). The display is redrawn from
+ * the main loop, flagged by CLOCK_TICK_FLAG.
+ */
+ISR(TIMER1_COMPA_vect)
+{
+	RAMSTAT_ISR_ENTER();
+	uint32_t now = timer1_nowLocked();
+	if ((int32_t)(now - tim1_deadline) < 0)
+	{
+		timer1_arm(); // not due yet
+		RAMSTAT_ISR_EXIT();
+		return;
+	}
+	TIMSK1 &= ~(1 << OCIE1A);
+
+	while ((int32_t)(now - clockMinuteStart) >= (int32_t)TIMER1_TICKS_PER_MIN)
+	{
+		clockMinuteStart += TIMER1_TICKS_PER_MIN;
+		clock_minuteTick();
+	}
+	resume_save();
+
+#if CLOCK_DIGITS == 8
+	/* Sleep till next second, on the grid of the minute start */
+	do
+		tim1_deadline += TIMER1_HZ;
+	while ((int32_t)(now - tim1_deadline) >= 0);
+#else
+	/* Sleep till next minute */
+	tim1_deadline = clockMinuteStart + TIMER1_TICKS_PER_MIN;
+#endif
+	timer1_arm();
+	flag_set(CLOCK_TICK_FLAG);
+	RAMSTAT_ISR_EXIT();
+}
+
+#ifdef POWERFAIL_ENABLE
+/*
+ * Interrupt Service Routine, ANALOG_COMP_vect
+ * -------------------------------------------
+ * Supply is failing: cuts display and buzzer, then saves time and alarms
+ * to EEPROM and keeps the longest save time seen. The comparator interrupt
+ * stays off, user_idle arms it again and switches the display back on
+ * once the supply is back (POWERFAIL_FLAG).
+ */
+ISR(ANALOG_COMP_vect)
+{
+	RAMSTAT_ISR_ENTER();
+	struct powerfail_struct record;
+	uint8_t *p = (uint8_t *)&record, sum = 0;
+	uint16_t ticks, maxTicks;
+	uint32_t start;
+
+	clkgov_request(CLKGOV_POWERFAIL); // shutdown and timing at full speed
+	BUZZER_port &= ~(1 << BUZZER_bit);
+	display_shutdownISR(1);
+
+	start = timer1_nowLocked();
+	record.magic = POWERFAIL_MAGIC;
+	record.clock = clock_pack(clockDigits);
+	record.weekday = clockWeekday;
+	for (uint8_t i = 0; i < ALARM_COUNT; i++)
+	{
+		record.alarmTimes[i] = clock_pack(alarms[i].digits);
+		record.alarmDays[i] = alarms[i].days;
+	}
+	while (p != &record.checksum)
+		sum += *p++;
+	record.checksum = ~sum;
+	eeprom_update_block(&record, &ee_powerfail, sizeof(record));
+	ticks = timer1_nowLocked() - start;
+
+	/* Only after the record, it is what counts */
+	maxTicks = eeprom_read_word(&ee_powerfailMaxTicks);
+	if ((maxTicks == 0xFFFF) || (ticks > maxTicks))
+		eeprom_update_word(&ee_powerfailMaxTicks, ticks);
+
+	ACSR &= ~(1 << ACIE);
+	flag_set(POWERFAIL_FLAG);
+	clkgov_release(CLKGOV_POWERFAIL);
+	RAMSTAT_ISR_EXIT();
+}
+#endif
+
+#ifdef RTC_DS3231
+/*
+ * Interrupt Service Routine, INT1_vect
+ * ------------------------------------
+ * DS3231 SQW, once per second: advances the time between the reads.
+ * A read is flagged at every full hour (RTC_SYNC_FLAG).
+ */
+ISR(INT1_vect)
+{
+	RAMSTAT_ISR_ENTER();
+	clockSeq++;
+	if (++clockSeconds > 59)
+	{
+		clockSeconds = 0;
+		clockMinuteStart = timer1_nowLocked();
+		clock_minuteTick();
+		if ((clockDigits[2] == 0) && (clockDigits[3] == 0))
+			flag_set(RTC_SYNC_FLAG);
+		flag_set(CLOCK_TICK_FLAG);
+	}
+#if CLOCK_DIGITS == 8
+	flag_set(CLOCK_TICK_FLAG);
+#endif
+	resume_save();
+	RAMSTAT_ISR_EXIT();
+}
+#endif
+
+/*
+ * Interrupt Service Routine, WDT_vect
+ * -----------------------------------
+ * Watchdog interrupt, wakes user_idle at least every RESUME_WDT_TIMEOUT.
+ * Hardware clears WDIE here, if user_idle does not set it again (main
+ * loop stuck) the next timeout resets.
+ */
+ISR(WDT_vect)
+{
+	RAMSTAT_ISR_ENTER();
+	RAMSTAT_ISR_EXIT();
+}
+
+/*
+ * Function: clock_minuteTick
+ * --------------------------
+ * Advances the clock by one minute and checks alarms.
+ * Called from Timer1 ISR.
+ */
+void clock_minuteTick(void)
+{
+	clockSeq++;
+	clockDigits[3]++;
+	if (clockDigits[3] > 9)
+	{
+		clockDigits[3] = 0;
+		clockDigits[2]++;
+		if (clockDigits[2] > 5)
+		{
+			clockDigits[2] = 0;
+			clockDigits[1]++;
+			if (clockDigits[0] < 2 && clockDigits[1] > 9)
+			{
+				clockDigits[1] = 0;
+				clockDigits[0]++;
+			}
+			else if (clockDigits[0] == 2 && clockDigits[1] > 3)
+			{
+				clockDigits[1] = 0;
+				clockDigits[0] = 0;
+				/* New day */
+				clockWeekday++;
+				if (clockWeekday > 6)
+					clockWeekday = 0;
+				alarm_schedule(1);
+			}
+		}
+	}
+
+	/* Check for alarm, days were already resolved by alarm_schedule */
+	if (flag_isSet(ALARM_SET_FLAG) && (clock_pack(clockDigits) == alarmNextTime))
+	{
+		flag_set(BUZZER_ACTIVATE_FLAG);
+		if (!(alarms[alarmNextSlot].days & ALARM_DAYS_MASK))
+			alarms[alarmNextSlot].days = 0; // one-shot, disarm
+		alarm_schedule(0);
+	}
+	return;
+}
+
+int main(void)
+{
+	uint8_t warmStart = resume_restore(), setTime;
+	flag_set(CLOCK_DISPLAY_FLAG);
+	wdt_enable(RESUME_WDT_TIMEOUT);
+	WDTCSR |= (1 << WDIE); // wakes user_idle, see WDT_vect
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	display_init(CLOCK_DIGITS);
+	ir_init();
+	remote_loadFilter();
+	keymap_load();
+	timer1_init(); // start timer, the user interface runs on software timers
+	powerfail_init();
+	if (!warmStart)
+		powerfail_restore(); // time of the power fail as a start, alarms back
+#ifdef RTC_DS3231
+	ds3231_init();
+	setTime = !rtc_load() && (rtcPresent || !warmStart); // RTC lost its time or is missing
+#else
+	setTime = !warmStart; // cold start only
+#endif
+	alarm_schedule(0);
+	clock_start(!warmStart); // ticking from here on, also while the time is entered
+#ifdef IR_LOOPBACK
+	if (!warmStart)
+		user_irLoopback(); // self-test, blocking function
+#endif
+	clkgov_init(); // slow down while idle from now on
+	if (setTime)
+		timeEntry_start(1); // runs from the main loop
+
+	// Loop forever until user presses Play/Pause button
+	uint8_t unmapped = 0, unmappedPresses = 0;
+	IR_receive_mask_clear;
+	while (1)
+	{
+		user_idle();
+		if (timeEntryStage != TIME_ENTRY_OFF)
+			timeEntry_poll(); // overlay takes the keys
+		else if (IR_receive_mask && !tw_isActive(&keyRepeatTimer))
+		{
+			uint8_t command = ir.command, key = keymap_action(command);
+			IR_receive_mask_clear;
+			if (key == KEY_NONE)
+			{
+				/* Unknown remote: the same key pressed repeatedly learns keys.
+				 * Only a remote passing the filter or over the defaults, without
+				 * a filter any remote in range would get there. */
+				unmappedPresses = (command == unmapped) ? unmappedPresses + 1 : 1;
+				unmapped = command;
+				if (unmappedPresses < KEYMAP_LEARN_PRESSES)
+					continue;
+				uint8_t lock = eeprom_lock(), remotes = eeprom_read_byte(&ee_remoteCount);
+				eeprom_unlock(lock);
+				if ((remotes == 0 || remotes > IR_ADDR_FILTER_MAX) && keymap_isLearned())
+				{
+					unmappedPresses = 0;
+					continue;
+				}
+				key = KEY_LEARN_KEYS;
+			}
+			unmappedPresses = 0;
+			if (key == KEY_ALARM_OFF)
+				alarmBuzzer_off();
+			else
+				user_mode(key);
+			continue;
+		}
+		if (flag_isSet(CLOCK_TICK_FLAG))
+		{
+			flag_clear(CLOCK_TICK_FLAG);
+			if (flag_isSet(CLOCK_DISPLAY_FLAG))
+			{
+				clkgov_request(CLKGOV_DISPLAY);
+				clockUpdateDisplay();
+				clkgov_release(CLKGOV_DISPLAY);
+			}
+		}
+		if (flag_isSet(BUZZER_ACTIVATE_FLAG))
+		{
+			flag_clear(BUZZER_ACTIVATE_FLAG);
+			alarmBuzzer_activate();
+		}
+#ifdef RTC_DS3231
+		if (flag_isSet(RTC_SYNC_FLAG) && ds3231_read(rtc_sync))
+		{
+			flag_clear(RTC_SYNC_FLAG); // else bus busy, next loop
+			tw_start(&rtcTimer, TW_MS(RTC_TIMEOUT_MS), 0, ds3231_abort);
+		}
+#endif
+	}
+}
+
+/**
+ * Function: user_mode
+ * ---------------------
+ * Runs the blocking mode selected by a mode key, then returns to the clock.
+ * Other keys are ignored.
+ * 
+ * key: action of the key received in the main loop (keymap.h)
+ */
+void user_mode(uint8_t key)
+{
+	switch (key)
+	{
+	case KEY_SET_ALARM:
+	case KEY_STOPWATCH:
+	case KEY_COUNTDOWN:
+	case KEY_LEARN_REMOTE:
+	case KEY_LEARN_KEYS:
+#ifdef RAMSTAT_ENABLE
+	case KEY_RAMSTAT:
+#endif
+#ifdef IR_CAPTURE
+	case KEY_IRDUMP:
+#endif
+		break;
+	default:
+		return;
+	}
+
+	tw_stop(&displayTimer);
+	flag_clear(CLOCK_DISPLAY_FLAG); // Dont show real clock while user is in a mode
+	clkgov_request(CLKGOV_UI);
+#if CLOCK_DIGITS == 8
+	display_blank(5, 4); // modes use digits 1-4
+#endif
+	switch (key)
+	{
+	case KEY_SET_ALARM:
+		user_setAlarm(); // mode button pressed, blocking function
+		break;
+	case KEY_STOPWATCH:
+	case KEY_COUNTDOWN:
+		user_stopwatch(key == KEY_COUNTDOWN); // blocking function
+		break;
+	case KEY_LEARN_REMOTE:
+		user_learnRemote(); // blocking function
+		break;
+	case KEY_LEARN_KEYS:
+		user_learnKeys(); // blocking function
+		break;
+#ifdef RAMSTAT_ENABLE
+	case KEY_RAMSTAT:
+		user_ramStats(); // blocking function
+		break;
+#endif
+#ifdef IR_CAPTURE
+	case KEY_IRDUMP:
+		user_irDump(); // blocking function
+		break;
+#endif
+	}
+	clkgov_release(CLKGOV_UI);
+	IR_receive_mask_clear;
+	if ((key == KEY_LEARN_REMOTE) || (key == KEY_LEARN_KEYS))
+		tw_start(&displayTimer, TW_MS(LEARN_RESULT_MS), 0, display_resume); // show result
+	else
+		display_resume();
+	return;
+}
+
+/**
+ * Function: user_idle
+ * ---------------------
+ * Work done while a loop waits for input: sleeps (idle mode) until the
+ * next interrupt, then feeds the watchdog and runs the expired software
+ * timers. No sleep while wheel ticks, a key past its repeat interval or
+ * a clock redraw are pending, an interrupt may have set them after the
+ * caller looked. Other events set in that window wait for the next
+ * interrupt, the watchdog one (RESUME_WDT_TIMEOUT) at the latest.
+ * 
+ */
+void user_idle(void)
+{
+	cli();
+	if (!tw_isDue() && !(IR_receive_mask && !tw_isActive(&keyRepeatTimer)) &&
+		!(flag_isSet(CLOCK_TICK_FLAG) && flag_isSet(CLOCK_DISPLAY_FLAG)))
+	{
+		uint16_t sleepStart = TCNT1;
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		cli();
+		sleep_disable();
+		idleTicks += (uint16_t)(TCNT1 - sleepStart);
+	}
+	sei();
+	wdt_reset();
+	WDTCSR |= (1 << WDIE); // next timeout wakes, the one after resets
+	tw_poll();
+#ifdef POWERFAIL_ENABLE
+	if (flag_isSet(POWERFAIL_FLAG) && !(ACSR & (1 << ACO)))
+	{
+		flag_clear(POWERFAIL_FLAG); // supply is back
+		powerfail_arm();
+		display_shutdown(0);
+	}
+#endif
+	return;
+}
+
+/**
+ * Function: display_resume
+ * ---------------------
+ * Returns the display to the running clock, redrawing every digit
+ * 
+ */
+void display_resume(void)
+{
+	for (uint8_t i = 0; i < CLOCK_DIGITS; i++)
+		clockShown[i] = 0xFF; // something else was shown
+	flag_set(CLOCK_DISPLAY_FLAG);
+	clockUpdateDisplay();
+	return;
+}
+
+/**
+ * Function: timer1_init
+ * ---------------------
+ * Initializes and starts Timer1 with settings:
+ * 		Normal Mode (free running), Overflow Interrupt Enabled
+ * 		Prescaler = 1024 (15625 ticks/sec at 16MHz)
+ * 		No deadline, the clock is started by clock_start
+ * 
+ */
+void timer1_init(void)
+{
+	cli();
+	TCCR1A = 0;
+	TCCR1B = (1 << CS12) | (1 << CS10);
+	TCNT1 = 0;
+	tim1_ovf = 0;
+	TIFR1 = (1 << TOV1) | (1 << OCF1A) | (1 << OCF1B);
+	TIMSK1 = (1 << TOIE1);
+	tim1_deadline = 0x7FFFFFFF; // out of reach till clock_start
+	sei();
+	return;
+}
+
+/**
+ * Function: clock_start
+ * ---------------------
+ * Starts counting minutes, compare A is armed at the next rollover
+ * (next second with CLOCK_DIGITS 8)
+ * 
+ * restart: 1 on a cold start, the minute starts now
+ *          0 to keep clockMinuteStart (warm restart, relative to timer1_init)
+ */
+void clock_start(uint8_t restart)
+{
+#ifdef RTC_DS3231
+	if (rtcPresent)
+	{
+		cli();
+		TIMSK1 &= ~(1 << OCIE1A); // no Timer1 deadline, it would tick twice
+		sei();
+		EIFR = (1 << INTF1);
+		EIMSK |= (1 << INT1); // ticked by the RTC SQW
+		clockUpdateDisplay();
+		return;
+	}
+#endif
+	cli();
+	if (restart)
+		clockMinuteStart = timer1_nowLocked();
+	clock_arm();
+	sei();
+	clockUpdateDisplay();
+	return;
+}
+
+/**
+ * Function: timer1_now
+ * ---------------------
+ * Returns the Timer1 tick count (TIMER1_HZ ticks/sec), safe from any context
+ * 
+ */
+uint32_t timer1_now(void)
+{
+	uint8_t sreg = SREG;
+	uint32_t now;
+	cli();
+	now = timer1_nowLocked();
+	SREG = sreg;
+	return now;
+}
+
+/**
+ * Function: clock_set
+ * ---------------------
+ * Sets the running clock in one step, the minute starts now. Alarms are
+ * rescheduled and the RTC is set too.
+ * 
+ * digits: HH.MM digits
+ * weekday: 0 = day 1 ... 6 = day 7
+ */
+void clock_set(const volatile int8_t *digits, uint8_t weekday)
+{
+	cli();
+	clockSeq++;
+	for (uint8_t i = 0; i < 4; i++)
+		clockDigits[i] = digits[i];
+	clockWeekday = weekday;
+	alarm_schedule(0);
+	clockMinuteStart = timer1_nowLocked();
+#ifdef RTC_DS3231
+	clockSeconds = 0;
+	if (!rtcPresent)
+		clock_arm(); // else the SQW ticks
+#else
+	clock_arm();
+#endif
+	resume_save();
+	sei();
+#ifdef RTC_DS3231
+	rtc_store();
+#endif
+	return;
+}
+
+/**
+ * Function: timeEntry_start
+ * ---------------------
+ * Starts the time entry overlay: the user edits a copy of the time and
+ * then the weekday (--n), both committed at once by CLOCK_DONE. The
+ * clock, alarms and IR keep running meanwhile, the main loop hands the
+ * keys to timeEntry_poll until the entry is done.
+ * 
+ * commit: 1 to set the clock to the entered time, 0 to drop it
+ */
+void timeEntry_start(uint8_t commit)
+{
+	struct clock_snapshot now;
+	clock_getSnapshot(&now);
+	for (uint8_t i = 0; i < 4; i++)
+		timeDigits[i] = now.digits[i];
+	timeWeekday = now.weekday;
+	timeEntryCommit = commit;
+	timeEntryKey = KEY_NONE;
+	timeEntryStage = TIME_ENTRY_DIGITS;
+
+	tw_stop(&displayTimer);
+	flag_clear(CLOCK_DISPLAY_FLAG); // Dont show real clock while the time is entered
+	clkgov_request(CLKGOV_UI);
+#if CLOCK_DIGITS == 8
+	display_blank(5, 4);
+#endif
+	digitPtr = 0;
+	display_setDigit(1, timeDigits[0] | 0b10000000); //add dot (.)
+	display_setDigit(2, timeDigits[1]);
+	display_setDigit(3, timeDigits[2]);
+	display_setDigit(4, timeDigits[3]);
+	return;
+}
+
+/**
+ * Function: timeEntry_poll
+ * ---------------------
+ * Handles the next key of the time entry overlay, the last one repeats
+ * while held. Returns at once if no key is pending or the repeat
+ * interval of the last key is not over.
+ * 
+ */
+void timeEntry_poll(void)
+{
+	uint8_t key = timeEntryKey;
+	if (tw_isActive(&keyRepeatTimer))
+		return;
+	if ((IR_receive_mask == 0) && (IR_hold_mask == 0))
+		return;
+	if ((IR_receive_mask == 1) && (IR_hold_mask == 0))
+	{
+		key = keymap_action(ir.command);
+		IR_receive_mask_clear;
+	}
+	if (key == KEY_ALARM_OFF)
+	{
+		alarmBuzzer_off();
+		key = KEY_NONE;
+	}
+	if (timeEntryStage == TIME_ENTRY_WEEKDAY)
+	{
+		switch (key)
+		{
+		case KEY_INC_DIGIT_NUM:
+			if (++timeWeekday > 6)
+				timeWeekday = 0;
+			break;
+		case KEY_DEC_DIGIT_NUM:
+			if (timeWeekday-- == 0)
+				timeWeekday = 6;
+			break;
+		case KEY_DONE:
+			timeEntryStage = TIME_ENTRY_OFF;
+			if (timeEntryCommit)
+				clock_set(timeDigits, timeWeekday);
+			clkgov_release(CLKGOV_UI);
+			display_resume();
+			tw_start(&keyRepeatTimer, TW_MS(KEY_REPEAT_MS), 0, 0);
+			return;
+		}
+		display_setDigit(4, timeWeekday + 1);
+		timeEntryKey = key;
+		tw_start(&keyRepeatTimer, TW_MS(KEY_REPEAT_MS), 0, 0);
+		return;
+	}
+	switch (key)
+	{
+	case KEY_INC_DIGIT:
+		clockControl_incDigit();
+		break;
+	case KEY_DEC_DIGIT:
+		clockControl_decDigit();
+		break;
+	case KEY_INC_DIGIT_NUM:
+		clockControl_incDigitNum();
+		break;
+	case KEY_DEC_DIGIT_NUM:
+		clockControl_decDigitNum();
+		break;
+	case KEY_DIGIT_0 ... KEY_DIGIT_9:
+		if (!time_enterDigit(timeDigits, &digitPtr, key - KEY_DIGIT_0))
+		{
+			key = KEY_NONE; // digits do not repeat while held
+			break;
+		}
+		/* fourth digit entered, falls through to DONE */
+	case KEY_DONE:
+		timeEntryStage = TIME_ENTRY_WEEKDAY;
+		key = KEY_NONE;
+		display_setDigit(1, CODEB_DASH);
+		display_setDigit(2, CODEB_DASH);
+		display_setDigit(3, CODEB_DASH);
+		display_setDigit(4, timeWeekday + 1);
+		break;
+	}
+	timeEntryKey = key;
+	tw_start(&keyRepeatTimer, TW_MS(KEY_REPEAT_MS), 0, 0);
+	return;
+}
+
+/**
+ * Function: clockControl_incDigit
+ * ---------------------
+ * Increases clock digit to the right
+ * 
+ */
+void clockControl_incDigit(void)
+{
+	display_setDigit(digitPtr + 1, timeDigits[digitPtr]); //remove dot (.)
+	digitPtr++;
+	if (digitPtr > 3)
+		digitPtr = 0;
+	display_setDigit(digitPtr + 1, timeDigits[digitPtr] | 0b10000000); //add dot (.)
+	return;
+}
+
+/**
+ * Function: clockControl_decDigit
+ * ---------------------
+ * Decrease clock digit to the right
+ * 
+ */
+void clockControl_decDigit(void)
+{
+	display_setDigit(digitPtr + 1, timeDigits[digitPtr]); //remove dot (.)
+	digitPtr--;
+	if (digitPtr > 3)
+		digitPtr = 3;
+	display_setDigit(digitPtr + 1, timeDigits[digitPtr] | 0b10000000); //add dot (.)
+	return;
+}
+
+/**
+ * Function: clockControl_incDigitNum
+ * ---------------------
+ * Increase clock digit num
+ * 
+ */
+void clockControl_incDigitNum(void)
+{
+	timeDigits[digitPtr]++;
+	switch (digitPtr)
+	{
+	case 0:
+		if (timeDigits[0] > 2)
+			timeDigits[0] = 0;
+		if (timeDigits[0] == 2)
+		{
+			if (timeDigits[1] > 3)
+				timeDigits[1] = 0;
+			display_setDigit(2, 0);
+		}
+		break;
+	case 1:
+		if (timeDigits[0] < 2)
+		{
+			if (timeDigits[1] > 9)
+				timeDigits[1] = 0;
+		}
+		else if (timeDigits[0] == 2)
+		{
+			if ((timeDigits[1]) > 3)
+				timeDigits[1] = 0;
+		}
+		break;
+	case 2:
+		if (timeDigits[2] > 5)
+			timeDigits[2] = 0;
+		break;
+	case 3:
+		if (timeDigits[3] > 9)
+			timeDigits[3] = 0;
+		break;
+	}
+	/* Update display */
+	display_setDigit(digitPtr + 1, timeDigits[digitPtr] | 0b10000000); //add dot (.)
+	return;
+}
+
+/**
+ * Function: clockControl_decDigitNum
+ * ---------------------
+ * Decrease clock digit num
+ * 
+ */
+void clockControl_decDigitNum(void)
+{
+	timeDigits[digitPtr]--;
+	switch (digitPtr)
+	{
+	case 0:
+		if (timeDigits[0] < 0)
+			timeDigits[0] = 2;
+		if (timeDigits[0] == 2)
+		{
+			if (timeDigits[1] > 3)
+				timeDigits[1] = 0;
+			display_setDigit(2, 0);
+		}
+		break;
+	case 1:
+		if (timeDigits[0] < 2)
+		{
+			if (timeDigits[1] < 0)
+				timeDigits[1] = 9;
+		}
+		else if (timeDigits[0] == 2)
+		{
+			if ((timeDigits[1]) < 0)
+				timeDigits[1] = 3;
+		}
+		break;
+	case 2:
+		if (timeDigits[2] < 0)
+			timeDigits[2] = 5;
+		break;
+	case 3:
+		if (timeDigits[3] < 0)
+			timeDigits[3] = 9;
+		break;
+	}
+	/* Update display */
+	display_setDigit(digitPtr + 1, timeDigits[digitPtr] | 0b10000000); //add dot (.)
+	return;
+}
+
+/**
+ * Function: time_enterDigit
+ * ---------------------
+ * Puts a digit typed on the keypad at the cursor of an HH.MM time and
+ * moves the cursor right. Digits making the time invalid are ignored,
+ * an hour of 2x clears a unit digit above 3.
+ * 
+ * digits: time being edited
+ * ptr: cursor (0-3), back to 0 after the fourth digit
+ * value: typed digit
+ * returns 1 when the fourth digit was entered
+ */
+uint8_t time_enterDigit(volatile int8_t *digits, volatile uint8_t *ptr, uint8_t value)
+{
+	uint8_t pos = *ptr;
+	switch (pos)
+	{
+	case 0:
+		if (value > 2)
+			return 0;
+		if ((value == 2) && (digits[1] > 3))
+		{
+			digits[1] = 0;
+			display_setDigit(2, 0);
+		}
+		break;
+	case 1:
+		if (value > ((digits[0] == 2) ? 3 : 9))
+			return 0;
+		break;
+	case 2:
+		if (value > 5)
+			return 0;
+		break;
+	}
+	digits[pos] = value;
+	display_setDigit(pos + 1, value); //remove dot (.)
+	if (pos == 3)
+	{
+		*ptr = 0;
+		return 1;
+	}
+	*ptr = ++pos;
+	display_setDigit(pos + 1, digits[pos] | 0b10000000); //add dot (.)
+	return 0;
+}
+
+/**
+ * Function: clockUpdateDisplay
+ * ---------------------
+ * Updates the display with the correct format: XX.XX, or XX.XX.XX d with
+ * seconds and weekday (CLOCK_DIGITS 8). Only the digits that changed since
+ * the last update are sent, so a second costs one or two register writes
+ * and the minute and hour digits are written on carry only.
+ * Main context only.
+ * 
+ */
+void clockUpdateDisplay(void)
+{
+	struct clock_snapshot now;
+	uint8_t digits[CLOCK_DIGITS];
+	clock_getSnapshot(&now);
+	digits[0] = now.digits[0];
+	digits[1] = now.digits[1] | 0b10000000; //dot in middle
+	digits[2] = now.digits[2];
+	digits[3] = now.digits[3];
+#if CLOCK_DIGITS == 8
+	digits[3] |= 0b10000000;
+	digits[4] = now.seconds / 10;
+	digits[5] = now.seconds % 10;
+	digits[6] = CODEB_BLANK;
+	digits[7] = now.weekday + 1;
+#endif
+	for (uint8_t i = 0; i < CLOCK_DIGITS; i++)
+	{
+		if (digits[i] == clockShown[i])
+			continue;
+		display_setDigit(i + 1, digits[i]);
+		clockShown[i] = digits[i];
+	}
+	return;
+}
+
+/**
+ * Function: clock_getSnapshot
+ * ---------------------
+ * Copies the running time without blocking interrupts. The copy is
+ * retried if Timer1 ISR rolled the minute meanwhile (clockSeq changed).
+ * The ISR cannot be preempted by the reader, so it never leaves a
+ * half written time behind and one bump per rollover is enough.
+ * Seconds are derived from the ticks elapsed in the current minute.
+ * 
+ * snap: where the time is stored
+ */
+void clock_getSnapshot(struct clock_snapshot *snap)
+{
+	uint8_t seq;
+	uint32_t ticks;
+	do
+	{
+		seq = clockSeq;
+		for (uint8_t i = 0; i < 4; i++)
+			snap->digits[i] = clockDigits[i];
+		snap->weekday = clockWeekday;
+		ticks = timer1_now() - clockMinuteStart;
+#ifdef RTC_DS3231
+		snap->seconds = clockSeconds;
+#endif
+	} while (seq != clockSeq);
+#ifdef RTC_DS3231
+	if (rtcPresent)
+		return;
+#endif
+	snap->seconds = ticks / TIMER1_HZ;
+	if (snap->seconds > 59)
+		snap->seconds = 59; // rollover due, ISR not run yet
+	return;
+}
+
+/**
+ * Function: user_setAlarm
+ * ---------------------
+ * User picks an alarm slot (P--n), sets its time and recurrence days
+ * 
+ */
+void user_setAlarm(void)
+{
+	uint8_t slot = 0, days;
+#if ALARM_COUNT > 1
+	slot = user_pickValue(CODEB_P, 1, 1, ALARM_COUNT) - 1;
+#endif
+
+	/*Load Alarm digits of the slot and show them so User will set alarm */
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		alarmDigits[i] = alarms[slot].digits[i];
+		display_setDigit(i + 1, alarmDigits[i]);
+	}
+	alarmPtr = 0;
+	display_setDigit(1, alarmDigits[0] | 0b10000000); //add dot (.)
+
+	/*User alarm button interface same as clock*/
+	uint8_t key = 0;
+
+	while (key != KEY_DONE)
+	{
+		user_idle();
+		if (tw_isActive(&keyRepeatTimer))
+			continue; // repeat interval of the last key not over
+		if ((IR_receive_mask == 0) && (IR_hold_mask == 0))
+			continue;
+		if ((IR_receive_mask == 1) && (IR_hold_mask == 0))
+		{
+			key = keymap_action(ir.command);
+			IR_receive_mask_clear;
+		}
+		switch (key)
+		{
+		case KEY_INC_DIGIT:
+			alarmControl_incDigit();
+			break;
+		case KEY_DEC_DIGIT:
+			alarmControl_decDigit();
+			break;
+		case KEY_INC_DIGIT_NUM:
+			alarmControl_incDigitNum();
+			break;
+		case KEY_DEC_DIGIT_NUM:
+			alarmControl_decDigitNum();
+			break;
+		case KEY_DIGIT_0 ... KEY_DIGIT_9:
+			/* fourth digit finishes like DONE, digits do not repeat while held */
+			key = time_enterDigit(alarmDigits, &alarmPtr, key - KEY_DIGIT_0) ? KEY_DONE : KEY_NONE;
+			break;
+		}
+		tw_start(&keyRepeatTimer, TW_MS(KEY_REPEAT_MS), 0, 0);
+	}
+
+	/* Recurrence days, then arm (or disarm) the slot */
+	days = user_setAlarmDays(alarms[slot].days);
+	cli();
+	for (uint8_t i = 0; i < 4; i++)
+		alarms[slot].digits[i] = alarmDigits[i];
+	alarms[slot].days = days;
+	alarm_schedule(0);
+	sei();
+	return;
+}
+
+/**
+ * Function: user_setAlarmDays
+ * ---------------------
+ * User selects the days an alarm repeats on, shown as d--x:
+ * d is the day (1-7) under the cursor, x is 1 when the alarm repeats on it.
+ * Digit keys move the cursor, digit num keys toggle the day.
+ * No days selected makes a one-shot alarm.
+ * 
+ * days: current days mask
+ * returns the new days with ALARM_ARMED, or 0 if user pressed ALARM_OFF
+ */
+uint8_t user_setAlarmDays(uint8_t days)
+{
+	uint8_t key = 0, day = 0;
+	days &= ALARM_DAYS_MASK;
+	display_setDigit(1, day + 1);
+	display_setDigit(2, CODEB_DASH);
+	display_setDigit(3, CODEB_DASH);
+	display_setDigit(4, days & 1);
+	while (1)
+	{
+		user_idle();
+		if (tw_isActive(&keyRepeatTimer))
+			continue; // repeat interval of the last key not over
+		if ((IR_receive_mask == 0) && (IR_hold_mask == 0))
+			continue;
+		if ((IR_receive_mask == 1) && (IR_hold_mask == 0))
+		{
+			key = keymap_action(ir.command);
+			IR_receive_mask_clear;
+		}
+		switch (key)
+		{
+		case KEY_INC_DIGIT:
+			day++;
+			if (day > 6)
+				day = 0;
+			break;
+		case KEY_DEC_DIGIT:
+			day--;
+			if (day > 6)
+				day = 6;
+			break;
+		case KEY_INC_DIGIT_NUM:
+		case KEY_DEC_DIGIT_NUM:
+			days ^= (1 << day);
+			break;
+		case KEY_DONE:
+			return days | ALARM_ARMED;
+		case KEY_ALARM_OFF:
+			return 0;
+		}
+		display_setDigit(1, day + 1);
+		display_setDigit(4, (days >> day) & 1);
+		tw_start(&keyRepeatTimer, TW_MS(KEY_REPEAT_MS), 0, 0);
+	}
+}
+
+/**
+ * Function: user_pickValue
+ * ---------------------
+ * User picks a single digit value, shown as s--n
+ * 
+ * symbol: code B character shown on the first digit
+ * value: initial value
+ * min, max: allowed range
+ * returns the picked value
+ */
+uint8_t user_pickValue(uint8_t symbol, uint8_t value, uint8_t min, uint8_t max)
+{
+	uint8_t key = 0;
+	display_setDigit(1, symbol);
+	display_setDigit(2, CODEB_DASH);
+	display_setDigit(3, CODEB_DASH);
+	display_setDigit(4, value);
+	while (1)
+	{
+		user_idle();
+		if (tw_isActive(&keyRepeatTimer))
+			continue; // repeat interval of the last key not over
+		if ((IR_receive_mask == 0) && (IR_hold_mask == 0))
+			continue;
+		if ((IR_receive_mask == 1) && (IR_hold_mask == 0))
+		{
+			key = keymap_action(ir.command);
+			IR_receive_mask_clear;
+		}
+		switch (key)
+		{
+		case KEY_INC_DIGIT_NUM:
+			value++;
+			if (value > max)
+				value = min;
+			break;
+		case KEY_DEC_DIGIT_NUM:
+			value--;
+			if ((value < min) || (value > max))
+				value = max;
+			break;
+		case KEY_DONE:
+			tw_start(&keyRepeatTimer, TW_MS(KEY_REPEAT_MS), 0, 0);
+			return value;
+		}
+		display_setDigit(4, value);
+		tw_start(&keyRepeatTimer, TW_MS(KEY_REPEAT_MS), 0, 0);
+	}
+}
+
+/**
+ * Function: alarm_schedule
+ * ---------------------
+ * Finds the earliest armed alarm still due today and stores it in
+ * alarmNextTime, so the Timer1 ISR needs one compare per minute.
+ * Called when alarms change, an alarm fires and on day rollover.
+ * Interrupts must be disabled.
+ * 
+ * inclusive: 1 to also accept an alarm at the current minute
+ */
+void alarm_schedule(uint8_t inclusive)
+{
+	uint16_t now = clock_pack(clockDigits), best = 0xFFFF, t;
+	uint8_t today = 1 << clockWeekday, days;
+	flag_clear(ALARM_SET_FLAG);
+	for (uint8_t i = 0; i < ALARM_COUNT; i++)
+	{
+		days = alarms[i].days;
+		if (!(days & ALARM_ARMED))
+			continue;
+		if ((days & ALARM_DAYS_MASK) && !(days & today))
+			continue;
+		t = clock_pack(alarms[i].digits);
+		if ((t < now) || ((t == now) && !inclusive) || (t >= best))
+			continue;
+		best = t;
+		alarmNextSlot = i;
+		flag_set(ALARM_SET_FLAG);
+	}
+	alarmNextTime = best;
+	return;
+}
+
+/**
+ * Function: alarmControl_incDigit
+ * ---------------------
+ * Increases alarm clock digit to the right
+ * 
+ */
+void alarmControl_incDigit(void)
+{
+	display_setDigit(alarmPtr + 1, alarmDigits[alarmPtr]); //remove dot (.)
+	alarmPtr++;
+	if (alarmPtr > 3)
+		alarmPtr = 0;
+	display_setDigit(alarmPtr + 1, alarmDigits[alarmPtr] | 0b10000000); //add dot (.)
+	return;
+}
+
+/**
+ * Function: alarmControl_decDigit
+ * ---------------------
+ * Decreases alarm clock digit to the right
+ * 
+ */
+void alarmControl_decDigit(void)
+{
+	display_setDigit(alarmPtr + 1, alarmDigits[alarmPtr]); //remove dot (.)
+	alarmPtr--;
+	if (alarmPtr > 3)
+		alarmPtr = 3;
+	display_setDigit(alarmPtr + 1, alarmDigits[alarmPtr] | 0b10000000); //add dot (.)
+	return;
+}
+
+/**
+ * Function: alarmControl_incDigitNum
+ * ---------------------
+ * Increases alarm clock digit
+ * 
+ */
+void alarmControl_incDigitNum(void)
+{
+	alarmDigits[alarmPtr]++;
+	switch (alarmPtr)
+	{
+	case 0:
+		if (alarmDigits[0] > 2)
+			alarmDigits[0] = 0;
+		if (alarmDigits[0] == 2)
+		{
+			if (alarmDigits[1] > 3)
+				alarmDigits[1] = 0;
+			display_setDigit(2, 0);
+		}
+		break;
+	case 1:
+		if (alarmDigits[0] < 2)
+		{
+			if (alarmDigits[1] > 9)
+				alarmDigits[1] = 0;
+		}
+		else if (alarmDigits[0] == 2)
+		{
+			if ((alarmDigits[1]) > 3)
+				alarmDigits[1] = 0;
+		}
+		break;
+	case 2:
+		if (alarmDigits[2] > 5)
+			alarmDigits[2] = 0;
+		break;
+	case 3:
+		if (alarmDigits[3] > 9)
+			alarmDigits[3] = 0;
+		break;
+	}
+
+	/* Update display */
+	display_setDigit(alarmPtr + 1, alarmDigits[alarmPtr] | 0b10000000); //add dot (.)
+	return;
+}
+
+/**
+ * Function: alarmControl_decDigitNum
+ * ---------------------
+ * Decreases alarm clock digit
+ * 
+ */
+void alarmControl_decDigitNum(void)
+{
+	alarmDigits[alarmPtr]--;
+	switch (alarmPtr)
+	{
+	case 0:
+		if (alarmDigits[0] < 0)
+			alarmDigits[0] = 2;
+		if (alarmDigits[0] == 2)
+		{
+			if (alarmDigits[1] > 3)
+				alarmDigits[1] = 0;
+			display_setDigit(2, 0);
+		}
+		break;
+	case 1:
+		if (alarmDigits[0] < 2)
+		{
+			if (alarmDigits[1] < 0)
+				alarmDigits[1] = 9;
+		}
+		else if (alarmDigits[0] == 2)
+		{
+			if ((alarmDigits[1]) < 0)
+				alarmDigits[1] = 3;
+		}
+		break;
+	case 2:
+		if (alarmDigits[2] < 0)
+			alarmDigits[2] = 5;
+		break;
+	case 3:
+		if (alarmDigits[3] < 0)
+			alarmDigits[3] = 9;
+		break;
+	}
+
+	/* Update display */
+	display_setDigit(alarmPtr + 1, alarmDigits[alarmPtr] | 0b10000000); //add dot (.)
+	return;
+}
+
+/**
+ * Function: alarmBuzzer_activate
+ * ---------------------
+ * Activates buzzer for ALARM_BUZZ_MS (10 seconds) or until user presses off.
+ * Returns at once, buzzerTimer turns the buzzer off.
+ * 
+ */
+void alarmBuzzer_activate(void)
+{
+	BUZZER_ddr |= (1 << BUZZER_bit);
+	BUZZER_port |= (1 << BUZZER_bit);
+	tw_start(&buzzerTimer, TW_MS(ALARM_BUZZ_MS), 0, alarmBuzzer_off);
+	return;
+}
+
+/**
+ * Function: alarmBuzzer_off
+ * ---------------------
+ * Turns off buzzer, on timeout or when user presses off
+ * 
+ */
+void alarmBuzzer_off(void)
+{
+	tw_stop(&buzzerTimer);
+	BUZZER_port &= ~(1 << BUZZER_bit);
+	return;
+}
+
+/**
+ * Function: remote_loadFilter
+ * ---------------------
+ * Loads the learned remote addresses from EEPROM into the IR decoder
+ * 
+ */
+void remote_loadFilter(void)
+{
+	ir_addr_t addresses[IR_ADDR_FILTER_MAX];
+	uint8_t lock = eeprom_lock(), count = eeprom_read_byte(&ee_remoteCount);
+	if (count > IR_ADDR_FILTER_MAX)
+		count = 0; // erased EEPROM, accept every remote
+	eeprom_read_block(addresses, ee_remoteAddr, sizeof(addresses));
+	eeprom_unlock(lock);
+	ir_setAddressFilter(addresses, count);
+	return;
+}
+
+/**
+ * Function: user_learnRemote
+ * ---------------------
+ * Adds the address of the next received frame to the accepted remotes.
+ * Display shows L--n, n being the number of learned remotes.
+ * The oldest remote is dropped when the list is full, ALARM_OFF forgets all
+ * and the LEARN key pressed again goes on to learn the keys.
+ * 
+ */
+void user_learnRemote(void)
+{
+	ir_addr_t addresses[IR_ADDR_FILTER_MAX], address;
+	uint8_t lock = eeprom_lock(), count = eeprom_read_byte(&ee_remoteCount), key, i;
+	if (count > IR_ADDR_FILTER_MAX)
+		count = 0;
+	eeprom_read_block(addresses, ee_remoteAddr, sizeof(addresses));
+	eeprom_unlock(lock);
+
+	display_setDigit(1, CODEB_L);
+	display_setDigit(2, CODEB_DASH);
+	display_setDigit(3, CODEB_DASH);
+	display_setDigit(4, count);
+
+	/* Accept any remote while learning */
+	ir_setAddressFilter(addresses, 0);
+	tw_start(&keyRepeatTimer, TW_MS(KEY_REPEAT_MS), 0, 0);
+	IR_receive_mask_clear;
+	while (1)
+	{
+		user_idle();
+		if (IR_receive_mask == 0)
+			continue;
+		if (!tw_isActive(&keyRepeatTimer))
+			break;
+		IR_receive_mask_clear; // still the LEARN key
+	}
+#ifdef PROTOCOL_NEC_EXTENDED
+	address = ((ir_addr_t)ir.address_h << 8) | ir.address_l;
+#else
+	address = ir.address;
+#endif
+	key = keymap_action(ir.command);
+	IR_receive_mask_clear;
+
+	if (key == KEY_LEARN_REMOTE)
+	{
+		ir_setAddressFilter(addresses, count);
+		user_learnKeys();
+		return;
+	}
+	if (key == KEY_ALARM_OFF)
+	{
+		count = 0;
+	}
+	else
+	{
+		for (i = 0; i < count; i++)
+		{
+			if (addresses[i] == address)
+				break;
+		}
+		if (i == count)
+		{
+			if (count == IR_ADDR_FILTER_MAX)
+			{
+				/* Drop the oldest remote */
+				for (i = 1; i < IR_ADDR_FILTER_MAX; i++)
+					addresses[i - 1] = addresses[i];
+				count--;
+			}
+			addresses[count++] = address;
+		}
+	}
+
+	eeprom_store(ee_remoteAddr, addresses, sizeof(addresses));
+	eeprom_store(&ee_remoteCount, &count, 1);
+	ir_setAddressFilter(addresses, count);
+	display_setDigit(4, count);
+	tw_start(&keyRepeatTimer, TW_MS(KEY_REPEAT_MS), 0, 0);
+	return;
+}
+
+/**
+ * Function: user_learnKeys
+ * ---------------------
+ * Asks for the key of every action in turn, display shows L-nn with nn
+ * the action (enum key_action). DONE is asked first, its key then skips
+ * an action. A key already taken is ignored. The map is stored in EEPROM
+ * after the last action. No key for KEYMAP_LEARN_TIMEOUT_MS abandons,
+ * the map stays as it was.
+ * 
+ */
+void user_learnKeys(void)
+{
+	uint8_t codes[KEY_ACTIONS], action = KEY_DONE, command, i;
+	uint32_t learned = 0;
+	struct tw_timer timeout = {0};
+
+	display_setDigit(1, CODEB_L);
+	display_setDigit(2, CODEB_DASH);
+	while (action < KEY_ACTIONS)
+	{
+		display_setDigit(3, action / 10);
+		display_setDigit(4, action % 10);
+		tw_start(&keyRepeatTimer, TW_MS(KEY_REPEAT_MS), 0, 0);
+		tw_start(&timeout, TW_MS(KEYMAP_LEARN_TIMEOUT_MS), 0, 0);
+		IR_receive_mask_clear;
+		while (1)
+		{
+			user_idle();
+			if (!tw_isActive(&timeout))
+				return; // abandoned, nothing saved
+			if (IR_receive_mask == 0)
+				continue;
+			if (!tw_isActive(&keyRepeatTimer))
+				break;
+			IR_receive_mask_clear; // still the previous key
+		}
+		tw_stop(&timeout);
+		command = ir.command;
+		IR_receive_mask_clear;
+
+		for (i = KEY_DONE; i < action; i++)
+		{
+			if ((learned & (1UL << i)) && (codes[i] == command))
+				break;
+		}
+		if (i == action)
+		{
+			codes[action] = command;
+			learned |= 1UL << action;
+			action++;
+		}
+		else if (i == KEY_DONE)
+		{
+			action++; // skipped, stays unmapped
+		}
+	}
+	keymap_save(codes, learned);
+	tw_start(&keyRepeatTimer, TW_MS(KEY_REPEAT_MS), 0, 0);
+	return;
+}
+
+/**
+ * Function: resume_save
+ * ---------------------
+ * Mirrors clock and alarm state into .noinit RAM.
+ * Called from the Timer1 ISRs, interrupts must be disabled.
+ * 
+ */
+void resume_save(void)
+{
+	uint8_t *p = (uint8_t *)&resumeState.clockDigits, sum = 0;
+	for (uint8_t i = 0; i < 4; i++)
+		resumeState.clockDigits[i] = clockDigits[i];
+	resumeState.minuteTicks = timer1_nowLocked() - clockMinuteStart;
+	resumeState.weekday = clockWeekday;
+	for (uint8_t i = 0; i < ALARM_COUNT; i++)
+		resumeState.alarms[i] = alarms[i];
+	while (p != &resumeState.checksum)
+		sum += *p++;
+	resumeState.checksum = ~sum;
+	resumeState.magic = RESUME_MAGIC;
+	return;
+}
+
+/**
+ * Function: resume_restore
+ * ---------------------
+ * Restores clock, weekday and alarms after a warm reset (watchdog, brown-out,
+ * external). Returns 1 on success, 0 on cold start or corrupted state.
+ * 
+ */
+uint8_t resume_restore(void)
+{
+	uint8_t *p = (uint8_t *)&resumeState.clockDigits, sum = 0;
+	if ((mcusr_mirror & (1 << PORF)) || (resumeState.magic != RESUME_MAGIC))
+		return 0;
+	while (p != &resumeState.checksum)
+		sum += *p++;
+	sum += resumeState.checksum;
+	if (sum != 0xFF) // sum + ~sum
+		return 0;
+	for (uint8_t i = 0; i < 4; i++)
+		clockDigits[i] = resumeState.clockDigits[i];
+	clockMinuteStart = 0 - resumeState.minuteTicks; // Timer1 restarts at 0
+	clockWeekday = resumeState.weekday;
+	for (uint8_t i = 0; i < ALARM_COUNT; i++)
+		alarms[i] = resumeState.alarms[i];
+	return 1;
+}
+
+/**
+ * Function: powerfail_init
+ * ---------------------
+ * Starts the analog comparator: bandgap against AIN1, interrupt when the
+ * supply falls below. The interrupt is enabled one wheel tick later from
+ * powerfailTimer, once the bandgap has started up (70us max).
+ * 
+ */
+void powerfail_init(void)
+{
+#ifdef POWERFAIL_ENABLE
+	DIDR1 = (1 << AIN1D);
+	ACSR = (1 << ACBG) | (1 << ACIS1) | (1 << ACIS0); // ACO rising: supply below
+	tw_start(&powerfailTimer, 1, 0, powerfail_arm);
+#endif
+	return;
+}
+
+/**
+ * Function: powerfail_arm
+ * ---------------------
+ * Enables the comparator interrupt, dropping an edge seen before
+ * 
+ */
+void powerfail_arm(void)
+{
+#ifdef POWERFAIL_ENABLE
+	ACSR |= (1 << ACI);
+	ACSR |= (1 << ACIE);
+#endif
+	return;
+}
+
+/**
+ * Function: eeprom_lock
+ * ---------------------
+ * Holds off the power-fail save (ANALOG_COMP_vect writes EEPROM too)
+ * while main context uses the EEPROM, so the ISR cannot come between
+ * loading EEAR/EEDR and the EEMPE/EEPE strobe. A supply drop meanwhile
+ * leaves ACI set and the save runs at eeprom_unlock.
+ * 
+ * returns what eeprom_unlock needs
+ */
+uint8_t eeprom_lock(void)
+{
+#ifdef POWERFAIL_ENABLE
+	uint8_t sreg = SREG, lock;
+	cli();
+	lock = ACSR & (1 << ACIE);
+	ACSR &= ~((1 << ACIE) | (1 << ACI)); // ACI written 0 stays as it is
+	SREG = sreg;
+	return lock;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Function: eeprom_unlock
+ * ---------------------
+ * Ends an eeprom_lock, a power fail seen meanwhile is handled now
+ * 
+ * lock: returned by eeprom_lock
+ */
+void eeprom_unlock(uint8_t lock)
+{
+#ifdef POWERFAIL_ENABLE
+	if (lock)
+		ACSR = (ACSR & ~(1 << ACI)) | (1 << ACIE);
+#endif
+	return;
+}
+
+/**
+ * Function: eeprom_store
+ * ---------------------
+ * eeprom_update_block for main context, locked byte by byte: a power
+ * fail waits one EEPROM write (3.4ms) at most, not the whole block
+ * 
+ * dst: EEPROM address
+ * src: bytes to store
+ * size: number of bytes
+ */
+void eeprom_store(void *dst, const void *src, uint8_t size)
+{
+	uint8_t lock;
+	for (uint8_t i = 0; i < size; i++)
+	{
+		lock = eeprom_lock();
+		eeprom_update_byte((uint8_t *)dst + i, ((const uint8_t *)src)[i]);
+		eeprom_unlock(lock);
+	}
+	return;
+}
+
+/**
+ * Function: powerfail_restore
+ * ---------------------
+ * Loads the state saved at the last power fail. Alarms and weekday are
+ * taken over, the time only seeds the time editor as it stood still.
+ * 
+ */
+void powerfail_restore(void)
+{
+#ifdef POWERFAIL_ENABLE
+	struct powerfail_struct record;
+	uint8_t *p = (uint8_t *)&record, sum = 0, lock = eeprom_lock();
+	eeprom_read_block(&record, &ee_powerfail, sizeof(record));
+	eeprom_unlock(lock);
+	if (record.magic != POWERFAIL_MAGIC)
+		return;
+	while (p != &record.checksum)
+		sum += *p++;
+	sum += record.checksum;
+	if (sum != 0xFF) // sum + ~sum
+		return;
+	clock_unpack(record.clock, clockDigits);
+	clockWeekday = record.weekday;
+	for (uint8_t i = 0; i < ALARM_COUNT; i++)
+	{
+		clock_unpack(record.alarmTimes[i], alarms[i].digits);
+		alarms[i].days = record.alarmDays[i];
+	}
+#endif
+	return;
+}
+
+#ifdef POWERFAIL_ENABLE
+/**
+ * Function: powerfail_maxMs
+ * ---------------------
+ * returns the longest power-fail save measured so far in ms, 0 if none
+ * 
+ */
+uint16_t powerfail_maxMs(void)
+{
+	uint8_t lock = eeprom_lock();
+	uint16_t ticks = eeprom_read_word(&ee_powerfailMaxTicks);
+	eeprom_unlock(lock);
+	if (ticks == 0xFFFF)
+		return 0; // erased, no power fail yet
+	return ((uint32_t)ticks * 1000 + TIMER1_HZ - 1) / TIMER1_HZ;
+}
+#endif
+
+#ifdef RTC_DS3231
+/**
+ * Function: rtc_sync
+ * ---------------------
+ * DS3231 callback (TWI ISR): takes the time read over into the clock.
+ * Reads are started right after an SQW edge, so the next edge cannot
+ * come between the read and this.
+ * 
+ * status: enum ds3231_status
+ * time: time read
+ */
+void rtc_sync(uint8_t status, const struct ds3231_time *time)
+{
+	rtcStatus = status;
+	if (status != DS3231_OK)
+		return;
+	clockSeq++;
+	clockDigits[0] = time->hours / 10;
+	clockDigits[1] = time->hours % 10;
+	clockDigits[2] = time->minutes / 10;
+	clockDigits[3] = time->minutes % 10;
+	clockWeekday = time->weekday;
+	clockSeconds = time->seconds;
+	clockMinuteStart = timer1_nowLocked() - (uint32_t)time->seconds * TIMER1_HZ;
+	alarm_schedule(0);
+	flag_set(CLOCK_TICK_FLAG);
+	return;
+}
+
+/**
+ * Function: rtc_stored
+ * ---------------------
+ * DS3231 callback (TWI ISR) of rtc_store
+ * 
+ * status: enum ds3231_status
+ * time: time written
+ */
+static void rtc_stored(uint8_t status, const struct ds3231_time *time)
+{
+	rtcStatus = status;
+	return;
+}
+
+/**
+ * Function: rtc_wait
+ * ---------------------
+ * Waits for the transfer just started, RTC_TIMEOUT_MS at most, then
+ * aborts it so the bus is free again
+ * 
+ * returns 1 if the transfer was done with DS3231_OK
+ */
+static uint8_t rtc_wait(void)
+{
+	struct tw_timer timeout = {0};
+	tw_stop(&rtcTimer); // the hourly read is over, the bus was free
+	tw_start(&timeout, TW_MS(RTC_TIMEOUT_MS), 0, 0);
+	while ((rtcStatus == RTC_PENDING) && tw_isActive(&timeout))
+		user_idle();
+	tw_stop(&timeout);
+	if (rtcStatus == RTC_PENDING)
+		ds3231_abort(); // callback sets DS3231_FAILED
+	return rtcStatus == DS3231_OK;
+}
+
+/**
+ * Function: rtc_load
+ * ---------------------
+ * Reads the time from the RTC at boot. An RTC that does not answer
+ * leaves the clock to Timer1.
+ * 
+ * returns 1 if the RTC had a valid time, the clock is set to it
+ */
+uint8_t rtc_load(void)
+{
+	rtcStatus = RTC_PENDING;
+	if (!ds3231_read(rtc_sync))
+		return 0;
+	rtc_wait();
+	rtcPresent = (rtcStatus == DS3231_OK) || (rtcStatus == DS3231_STOPPED);
+	return rtcStatus == DS3231_OK;
+}
+
+/**
+ * Function: rtc_store
+ * ---------------------
+ * Sets the RTC to the clock time with seconds 0, e.g. after clock_set
+ * 
+ */
+void rtc_store(void)
+{
+	struct ds3231_time time;
+	if (!rtcPresent)
+		return;
+	time.seconds = 0;
+	time.minutes = clockDigits[2] * 10 + clockDigits[3];
+	time.hours = clockDigits[0] * 10 + clockDigits[1];
+	time.weekday = clockWeekday;
+	rtcStatus = RTC_PENDING;
+	if (ds3231_write(&time, rtc_stored))
+		rtc_wait();
+	cli();
+	clockSeconds = 0;
+	clockMinuteStart = timer1_nowLocked();
+	sei();
+	return;
+}
+#endif
+
+/**
+ * Function: user_stopwatch
+ * ---------------------
+ * Stopwatch or countdown (kitchen timer) mode, refreshed at 100Hz
+ * by a periodic software timer:
+ * 		SS.hh below one minute, MM.SS above
+ * 		INC_DIGIT starts/stops, DEC_DIGIT resets
+ * 		INC/DEC_DIGIT_NUM set the countdown minutes while reset
+ * 		ALARM_OFF shows the CPU load as L x.x (percent)
+ * 		CLOCK_DONE returns to the clock
+ * The clock keeps running meanwhile. A finished countdown or a due
+ * alarm leave the mode so that main sounds the buzzer.
+ * The load is the part of each second not slept in user_idle, so it
+ * includes the interrupts along with the refresh. Timer1 ticks (64us)
+ * bound the resolution, the interrupt that ends a sleep is counted idle.
+ * No reading of the load has been taken yet, on a board or in simavr.
+ * 
+ * countdown: 0 for stopwatch, 1 for countdown
+ */
+void user_stopwatch(uint8_t countdown)
+{
+	uint32_t startTicks = 0, accTicks = 0, shown, duration = TIMER1_TICKS_PER_MIN;
+	uint8_t running = 0, loadHold = 0, key;
+	uint8_t loadCount = 0;
+	uint16_t load = 0;
+	uint32_t loadStart = timer1_now(), loadIdle = idleTicks, elapsed, slept;
+
+	/* Refresh timer */
+	flag_clear(STOPWATCH_REFRESH_FLAG);
+	tw_start(&refreshTimer, 1, TW_TICK_HZ / STOPWATCH_REFRESH_HZ, stopwatch_refresh);
+
+	while (1)
+	{
+		user_idle();
+		if (IR_receive_mask)
+		{
+			key = keymap_action(ir.command);
+			IR_receive_mask_clear;
+			if (key == KEY_DONE)
+				break;
+			switch (key)
+			{
+			case KEY_INC_DIGIT:
+				if (running)
+					accTicks += timer1_now() - startTicks;
+				else
+					startTicks = timer1_now();
+				running ^= 1;
+				break;
+			case KEY_DEC_DIGIT:
+				accTicks = 0;
+				startTicks = timer1_now();
+				break;
+			case KEY_INC_DIGIT_NUM:
+				if (!running && !accTicks && (duration < COUNTDOWN_MAX_MIN * TIMER1_TICKS_PER_MIN))
+					duration += TIMER1_TICKS_PER_MIN;
+				break;
+			case KEY_DEC_DIGIT_NUM:
+				if (!running && !accTicks && (duration > TIMER1_TICKS_PER_MIN))
+					duration -= TIMER1_TICKS_PER_MIN;
+				break;
+			case KEY_ALARM_OFF:
+				loadHold = STOPWATCH_REFRESH_HZ; // show for one second
+				display_setDigit(1, CODEB_L);
+				display_setNumber(load, 2, 3, 3, DISPLAY_BLANK_ZEROS);
+				break;
+			}
+		}
+		if (flag_isSet(BUZZER_ACTIVATE_FLAG))
+			break; // alarm due
+		if (!flag_isSet(STOPWATCH_REFRESH_FLAG))
+			continue;
+		flag_clear(STOPWATCH_REFRESH_FLAG);
+
+		/* Refresh */
+		shown = accTicks;
+		if (running)
+			shown += timer1_now() - startTicks;
+		if (countdown)
+		{
+			if (shown >= duration)
+			{
+				stopwatchUpdateDisplay(0);
+				flag_set(BUZZER_ACTIVATE_FLAG);
+				break;
+			}
+			shown = duration - shown;
+		}
+		if (loadHold)
+			loadHold--;
+		else
+			stopwatchUpdateDisplay(shown);
+
+		/* Load in per mille: Timer1 ticks not slept over the last second */
+		if (++loadCount == STOPWATCH_REFRESH_HZ)
+		{
+			elapsed = timer1_now() - loadStart;
+			slept = idleTicks - loadIdle;
+			load = slept < elapsed ? 1000 - slept * 1000 / elapsed : 0;
+			loadStart += elapsed;
+			loadIdle += slept;
+			loadCount = 0;
+		}
+	}
+
+	tw_stop(&refreshTimer);
+	return;
+}
+
+/**
+ * Function: stopwatchUpdateDisplay
+ * ---------------------
+ * Shows ticks as SS.hh below one minute, MM.SS above (minutes mod 100)
+ * 
+ * ticks: Timer1 ticks to show
+ */
+void stopwatchUpdateDisplay(uint32_t ticks)
+{
+	uint16_t seconds = ticks / TIMER1_HZ;
+	uint8_t hundredths = (ticks % TIMER1_HZ) * 100 / TIMER1_HZ;
+	if (seconds < 60)
+		display_setNumber(seconds * 100 + hundredths, 1, 4, 2, 0);
+	else
+		display_setNumber((seconds / 60 % 100) * 100 + seconds % 60, 1, 4, 2, 0);
+	return;
+}
+
+/**
+ * Function: stopwatch_refresh
+ * ---------------------
+ * refreshTimer callback, requests a stopwatch display refresh
+ * 
+ */
+void stopwatch_refresh(void)
+{
+	flag_set(STOPWATCH_REFRESH_FLAG);
+	return;
+}
+
+#ifdef RAMSTAT_ENABLE
+/**
+ * Function: user_ramStats
+ * ---------------------
+ * Hidden page with the RAM high-water marks (see ramstat.c).
+ * Each page shows its symbol as X--- for RAMSTAT_SPLASH_MS, then the value:
+ * 		P: peak stack use in bytes
+ * 		H: headroom, bytes the stack never reached
+ * 		L: deepest ISR nesting level
+ * 		E: longest power-fail save in ms (POWERFAIL_ENABLE)
+ * 		1.: CPU cycles of a full display redraw (DISPLAY_BENCH)
+ * 		2.: display CPU load redrawing at 100Hz, xx.x percent (DISPLAY_BENCH)
+ * The display pages run display_benchmark each time they are shown.
+ * Digit keys change page, CLOCK_DONE returns to the clock.
+ * 
+ */
+void user_ramStats(void)
+{
+	static const uint8_t symbols[] = {
+		CODEB_P, CODEB_H, CODEB_L,
+#ifdef POWERFAIL_ENABLE
+		CODEB_E,
+#endif
+#ifdef DISPLAY_BENCH
+		1 | CODEB_DP, 2 | CODEB_DP,
+#endif
+	};
+	const uint8_t last = sizeof(symbols) - 1;
+	struct tw_timer splash = {0};
+	struct ramstat stat;
+#ifdef DISPLAY_BENCH
+	struct display_bench bench;
+#endif
+	uint8_t key = KEY_INC_DIGIT, page = last, shown = 0, dp; // wraps to the first page
+	uint16_t value;
+
+	while (1)
+	{
+		user_idle();
+		if (!shown && !tw_isActive(&splash))
+		{
+			ramstat_get(&stat);
+			dp = 0;
+			switch (symbols[page])
+			{
+			case CODEB_P:
+				value = stat.stackPeak;
+				break;
+			case CODEB_H:
+				value = stat.headroom;
+				break;
+#ifdef POWERFAIL_ENABLE
+			case CODEB_E:
+				value = powerfail_maxMs();
+				break;
+#endif
+#ifdef DISPLAY_BENCH
+			case 1 | CODEB_DP:
+				display_benchmark(&bench);
+				value = bench.redrawCycles;
+				break;
+			case 2 | CODEB_DP:
+				display_benchmark(&bench);
+				value = bench.loadPermille;
+				dp = 3;
+				break;
+#endif
+			default:
+				value = stat.isrNestMax;
+				break;
+			}
+			display_setNumber(value, 1, 4, dp, DISPLAY_BLANK_ZEROS);
+			shown = 1;
+		}
+		if (key == 0)
+		{
+			if (tw_isActive(&keyRepeatTimer) || (IR_receive_mask == 0))
+				continue;
+			key = keymap_action(ir.command);
+			IR_receive_mask_clear;
+		}
+		switch (key)
+		{
+		case KEY_INC_DIGIT:
+			page++;
+			if (page > last)
+				page = 0;
+			break;
+		case KEY_DEC_DIGIT:
+			page--;
+			if (page > last)
+				page = last;
+			break;
+		case KEY_DONE:
+			tw_stop(&splash);
+			tw_start(&keyRepeatTimer, TW_MS(KEY_REPEAT_MS), 0, 0);
+			return;
+		default:
+			key = 0;
+			continue;
+		}
+		key = 0;
+		display_setDigit(1, symbols[page]);
+		display_setDigit(2, CODEB_DASH);
+		display_setDigit(3, CODEB_DASH);
+		display_setDigit(4, CODEB_DASH);
+		tw_start(&splash, TW_MS(RAMSTAT_SPLASH_MS), 0, 0);
+		shown = 0;
+		tw_start(&keyRepeatTimer, TW_MS(KEY_REPEAT_MS), 0, 0);
+	}
+}
+#endif
+
+#ifdef IR_LOOPBACK
+/**
+ * Function: loopback_step
+ * ---------------------
+ * loopbackTimer callback: keeps the latency of the frame sent last and
+ * sends the next one. After LOOPBACK_ROUNDS rounds of loopbackKeys two
+ * CLOCK_DONE frames leave the time and weekday entry.
+ * 
+ */
+void loopback_step(void)
+{
+	uint8_t key, command, n = loopbackSent;
+	if ((n > 0) && (n <= LOOPBACK_KEYS * LOOPBACK_ROUNDS))
+		loopbackTicks[(n - 1) % LOOPBACK_KEYS][(n - 1) / LOOPBACK_KEYS] = irtx_latency();
+	if (n < LOOPBACK_KEYS * LOOPBACK_ROUNDS)
+		key = loopbackKeys[n % LOOPBACK_KEYS];
+	else if (n < LOOPBACK_KEYS * LOOPBACK_ROUNDS + 2)
+		key = KEY_DONE;
+	else
+	{
+		tw_stop(&loopbackTimer);
+		return;
+	}
+	if (keymap_command(key, &command) && irtx_send(loopbackAddress, command))
+		loopbackSent++; // else retried next time
+	return;
+}
+
+/**
+ * Function: loopback_sort
+ * ---------------------
+ * Sorts the latencies of one key, insertion sort
+ * 
+ * ticks: LOOPBACK_ROUNDS latencies
+ */
+static void loopback_sort(uint16_t *ticks)
+{
+	for (uint8_t i = 1; i < LOOPBACK_ROUNDS; i++)
+	{
+		uint16_t value = ticks[i];
+		uint8_t j = i;
+		while (j && (ticks[j - 1] > value))
+		{
+			ticks[j] = ticks[j - 1];
+			j--;
+		}
+		ticks[j] = value;
+	}
+	return;
+}
+
+/**
+ * Function: user_irLoopback
+ * ---------------------
+ * IR loopback self-test: the time entry overlay is driven by frames sent
+ * from the IR LED (irtx.c), each latency runs from the end of the frame
+ * to the first display write after it. The entered time is dropped.
+ * Results, one page per key of loopbackKeys and statistic, shown as
+ * k-s- for RAMSTAT_SPLASH_MS then the latency in ms (xx.x):
+ * 		k: key 1-4 (INC_DIGIT_NUM, INC_DIGIT, DEC_DIGIT_NUM, DEC_DIGIT)
+ * 		s: 5 median, 9 90th percentile, H highest
+ * ---- when a frame got no display write. Digit keys change page,
+ * CLOCK_DONE goes on to the time entry.
+ * 
+ */
+void user_irLoopback(void)
+{
+	static const uint8_t symbols[] = {5, 9, CODEB_H};
+	struct tw_timer splash = {0};
+	uint8_t count, key = KEY_INC_DIGIT, page = 0xFF, shown = 0, lock;
+	uint16_t ticks;
+
+	lock = eeprom_lock();
+	count = eeprom_read_byte(&ee_remoteCount);
+	if ((count > 0) && (count <= IR_ADDR_FILTER_MAX))
+		eeprom_read_block(&loopbackAddress, &ee_remoteAddr[0], sizeof(loopbackAddress));
+	eeprom_unlock(lock);
+	irtx_init();
+	loopbackSent = 0;
+	for (uint8_t i = 0; i < LOOPBACK_KEYS; i++)
+	{
+		for (uint8_t j = 0; j < LOOPBACK_ROUNDS; j++)
+			loopbackTicks[i][j] = IRTX_NO_LATENCY;
+	}
+	tw_start(&loopbackTimer, TW_MS(LOOPBACK_PERIOD_MS), TW_MS(LOOPBACK_PERIOD_MS), loopback_step);
+	timeEntry_start(0); // driven by the frames
+	while (timeEntryStage != TIME_ENTRY_OFF)
+	{
+		user_idle();
+		timeEntry_poll(); // as from the main loop
+	}
+	tw_stop(&loopbackTimer);
+	for (uint8_t i = 0; i < LOOPBACK_KEYS; i++)
+		loopback_sort(loopbackTicks[i]);
+
+	while (1)
+	{
+		user_idle();
+		if (!shown && !tw_isActive(&splash))
+		{
+			if (page % 3 == 0)
+				ticks = loopbackTicks[page / 3][LOOPBACK_ROUNDS / 2];
+			else if (page % 3 == 1)
+				ticks = loopbackTicks[page / 3][LOOPBACK_ROUNDS * 9 / 10];
+			else
+				ticks = loopbackTicks[page / 3][LOOPBACK_ROUNDS - 1];
+			if (ticks == IRTX_NO_LATENCY)
+			{
+				for (uint8_t i = 1; i <= 4; i++)
+					display_setDigit(i, CODEB_DASH);
+			}
+			else
+				display_setNumber((uint32_t)ticks * 10000 / TIMER1_HZ, 1, 4, 3, DISPLAY_BLANK_ZEROS); // 0.1ms
+			shown = 1;
+		}
+		if (key == 0)
+		{
+			if (tw_isActive(&keyRepeatTimer) || (IR_receive_mask == 0))
+				continue;
+			key = keymap_action(ir.command);
+			IR_receive_mask_clear;
+		}
+		switch (key)
+		{
+		case KEY_INC_DIGIT:
+			page++;
+			if (page >= LOOPBACK_KEYS * 3)
+				page = 0;
+			break;
+		case KEY_DEC_DIGIT:
+			page--;
+			if (page >= LOOPBACK_KEYS * 3)
+				page = LOOPBACK_KEYS * 3 - 1;
+			break;
+		case KEY_DONE:
+			tw_stop(&splash);
+			tw_start(&keyRepeatTimer, TW_MS(KEY_REPEAT_MS), 0, 0);
+			return;
+		default:
+			key = 0;
+			continue;
+		}
+		key = 0;
+		display_setDigit(1, page / 3 + 1);
+		display_setDigit(2, CODEB_DASH);
+		display_setDigit(3, symbols[page % 3]);
+		display_setDigit(4, CODEB_DASH);
+		tw_start(&splash, TW_MS(RAMSTAT_SPLASH_MS), 0, 0);
+		shown = 0;
+		tw_start(&keyRepeatTimer, TW_MS(KEY_REPEAT_MS), 0, 0);
+	}
+}
+#endif
+
+#ifdef IR_CAPTURE
+/**
+ * Function: user_irDump
+ * ---------------------
+ * Hidden viewer of the raw IR capture (see libnecdecoder.h), recording
+ * is paused meanwhile so the keys pressed here do not push frames out.
+ * INC/DEC_DIGIT_NUM pick the frame (newest first), digit keys step through it:
+ * 		rs nn	reason (ir_capture_reason_t), state it ended in, number of edges
+ * 		E ccc	tick count that ended the frame
+ * 		L ttt	mark of ttt Timer 0 ticks, H ttt space, alternating
+ * Shows ---- when nothing was captured, CLOCK_DONE returns to the clock.
+ * 
+ */
+void user_irDump(void)
+{
+	struct ir_capture frame;
+	uint8_t key = 0, age = 0, item = 0, valid;
+
+	ir_capturePause(1);
+	valid = ir_captureGet(age, &frame);
+	while (1)
+	{
+		/* Show the selected item */
+		if (!valid)
+		{
+			for (uint8_t i = 1; i <= 4; i++)
+				display_setDigit(i, CODEB_DASH);
+		}
+		else if (item == 0)
+		{
+			display_setDigit(1, frame.reason);
+			display_setDigit(2, frame.state | 0b10000000);
+			display_setNumber(frame.edges_cnt, 3, 2, 0, 0);
+		}
+		else if (item == 1)
+		{
+			display_setDigit(1, CODEB_E);
+			display_setNumber(frame.count, 2, 3, 0, DISPLAY_BLANK_ZEROS);
+		}
+		else
+		{
+			display_setDigit(1, (item & 1) ? CODEB_H : CODEB_L);
+			display_setNumber(frame.edges[item - 2], 2, 3, 0, DISPLAY_BLANK_ZEROS);
+		}
+
+		/* Wait for a key */
+		do
+		{
+			user_idle();
+		} while (tw_isActive(&keyRepeatTimer) || ((IR_receive_mask == 0) && (IR_hold_mask == 0)));
+		if (IR_receive_mask && !IR_hold_mask)
+		{
+			key = keymap_action(ir.command);
+			IR_receive_mask_clear;
+		}
+		tw_start(&keyRepeatTimer, TW_MS(KEY_REPEAT_MS), 0, 0);
+		switch (key)
+		{
+		case KEY_INC_DIGIT:
+			if (valid && (item < frame.edges_cnt + 1))
+				item++;
+			break;
+		case KEY_DEC_DIGIT:
+			if (item)
+				item--;
+			break;
+		case KEY_INC_DIGIT_NUM:
+			if (ir_captureGet(age + 1, &frame))
+				age++;
+			item = 0;
+			break;
+		case KEY_DEC_DIGIT_NUM:
+			if (age)
+				age--;
+			item = 0;
+			break;
+		case KEY_DONE:
+			ir_capturePause(0);
+			return;
+		}
+		valid = ir_captureGet(age, &frame);
+	}
+}
+#endif
\ No newline at end of file
@@ -1,50 +1,196 @@
-
-#ifndef MAIN_H
-#define MAIN_H
-
-#ifndef F_CPU
-#warning "F_CPU undefined, set to 16MHz"
-#define F_CPU 16000000UL
-#endif
-
-#include <inttypes.h>
-
-/* Buzzer hardware pins definitions */
-#define BUZZER_ddr DDRC
-#define BUZZER_port PORTC
-#define BUZZER_bit PORTC5
-
-/* Definitions for the Remote Controller Codes that control the alarm. */
-#define INC_DIGIT_NUM_IRcommand 0x0D
-#define DEC_DIGIT_NUM_IRcommand 0x19
-#define INC_DIGIT_IRcommand 0x43
-#define DEC_DIGIT_IRcommand 0x40
-#define CLOCK_DONE_IRcommmand 0x44
-#define SET_ALARM_IRcommand 0x46
-#define ALARM_OFF_IRcommand 0x45
-
-/* IR masks */
-#define IR_receive_mask (ir.status & (1 << IR_RECEIVED))
-#define IR_receive_mask_clear (ir.status &= ~(1 << IR_RECEIVED))
-#define IR_hold_mask (ir.status & (1 << IR_KEYHOLD))
-
-/* General definitions */
-#define HIGH(x) (((x) >> 8) & 0xFF)
-#define LOW(x) ((x)&0xFF)
-
-/* Functions declarations */
-void timer1_init(void);
-void user_setTime(void);
-void clockControl_incDigit(void);
-void clockControl_decDigit(void);
-void clockControl_incDigitNum(void);
-void clockControl_decDigitNum(void);
-void clockUpdateDisplay(void);
-void user_setAlarm(void);
-void alarmControl_incDigit(void);
-void alarmControl_decDigit(void);
-void alarmControl_incDigitNum(void);
-void alarmControl_decDigitNum(void);
-void alarmBuzzer_activate(void);
-
+
+#ifndef MAIN_H
+#define MAIN_H
+
+#ifndef F_CPU
+#warning "F_CPU undefined, set to 16MHz"
+#define F_CPU 16000000UL
+#endif
+
+#include <inttypes.h>
+
+/* Timer1 timebase: free running tick count, compare A at the next deadline */
+#define TIMER1_PRESCALER 1024
+#define TIMER1_HZ (F_CPU / TIMER1_PRESCALER) // 15625 at 16MHz
+#define TIMER1_TICKS_PER_MIN (TIMER1_HZ * 60UL)
+#define TIMER1_MARGIN 4 // closer deadlines are pushed back to this many ticks
+
+/* Uncomment to keep time with a DS3231 RTC (ds3231.h): its 1Hz SQW ticks
+ * the clock, the time is read at boot and re-read every full hour. Timer1
+ * is then left to the software timers, and takes over the clock again if
+ * the RTC does not answer at boot. */
+//#define RTC_DS3231
+#define RTC_TIMEOUT_MS 100 // read or write of the RTC, aborted after
+
+/* Clock display: 4 digits HH.MM, or 8 digits HH.MM.SS plus the weekday (1-7)
+ * on the last digit. Other modes keep using digits 1-4. */
+#define CLOCK_DIGITS 4
+
+/* Buzzer hardware pins definitions, PC5 is the TWI SCL with RTC_DS3231 */
+#define BUZZER_ddr DDRC
+#define BUZZER_port PORTC
+#ifdef RTC_DS3231
+#define BUZZER_bit PORTC3
+#else
+#define BUZZER_bit PORTC5
+#endif
+
+/* Remote key codes and actions are in keymap.h */
+
+/* Cross-ISR flags, kept in GPIOR0 so they compile to sbi/cbi/sbis/sbic */
+#define FLAGS GPIOR0
+#define CLOCK_DISPLAY_FLAG 0
+#define ALARM_SET_FLAG 1
+#define BUZZER_ACTIVATE_FLAG 2
+#define STOPWATCH_REFRESH_FLAG 3
+#define CLOCK_TICK_FLAG 4 // shown time changed, redraw from main loop
+#define RTC_SYNC_FLAG 5	  // full hour, re-read the time from the RTC
+#define POWERFAIL_FLAG 6  // state saved, comparator off until the supply is back
+#define flag_set(f) (FLAGS |= (1 << (f)))
+#define flag_clear(f) (FLAGS &= ~(1 << (f)))
+#define flag_isSet(f) (FLAGS & (1 << (f)))
+
+/* Consistent copy of the running time, see clock_getSnapshot */
+struct clock_snapshot
+{
+	int8_t digits[4];
+	uint8_t seconds;
+	uint8_t weekday;
+};
+
+/* Time entry overlay (timeEntry_start) */
+#define TIME_ENTRY_OFF 0
+#define TIME_ENTRY_DIGITS 1	 // HH.MM, cursor digit has the dot
+#define TIME_ENTRY_WEEKDAY 2 // --n
+
+/* IR masks */
+#define IR_receive_mask (ir.status & (1 << IR_RECEIVED))
+#define IR_receive_mask_clear (ir.status &= ~(1 << IR_RECEIVED))
+#define IR_hold_mask (ir.status & (1 << IR_KEYHOLD))
+
+/* Alarms: time of day plus recurrence days (bit0 = day 1 ... bit6 = day 7) */
+#define ALARM_COUNT 2
+#define ALARM_DAYS_MASK 0x7F // no day set: fires once at the next occurrence
+#define ALARM_ARMED 0x80
+struct alarm_struct
+{
+	int8_t digits[4];
+	uint8_t days;
+};
+
+/* User interface timing, software timers (timerwheel.h) */
+#define KEY_REPEAT_MS 200	 // key repeat while held, also debounces presses
+#define LEARN_RESULT_MS 500	 // learned remote count shown before the clock
+#define RAMSTAT_SPLASH_MS 600 // RAM use page symbol shown before the value
+#define ALARM_BUZZ_MS 10000 // buzzer sounds until off key or this timeout
+
+/* Stopwatch / countdown: display refresh from a periodic software timer */
+#define STOPWATCH_REFRESH_HZ 100
+#define COUNTDOWN_MAX_MIN 99
+
+/* Warm restart: clock and alarm state kept in .noinit RAM across resets.
+ * Saved by the interrupts that already run (Timer1 overflow every 4.2s,
+ * minute rollover, RTC second, clock_set), not by a timer of its own, so
+ * a warm reset sets the clock back by up to 4.2s (1s with the RTC). */
+#define RESUME_MAGIC 0xC10C
+#define RESUME_WDT_TIMEOUT WDTO_2S
+struct resume_struct
+{
+	uint16_t magic;
+	int8_t clockDigits[4];
+	uint32_t minuteTicks; // Timer1 ticks into the current minute
+	uint8_t weekday;
+	struct alarm_struct alarms[ALARM_COUNT];
+	uint8_t checksum;
+};
+
+/* Power-fail save: the analog comparator watches the raw supply (before
+ * the regulator) through a divider on AIN1 (PD7) against the 1.1V bandgap,
+ * divided so it crosses while the regulator still holds 5V. Then display
+ * and buzzer are cut and time and alarms are written to EEPROM on what is
+ * left in the supply capacitor. Needs the divider, AIN1 must not float. */
+//#define POWERFAIL_ENABLE
+#define POWERFAIL_MAGIC 0xFA
+struct powerfail_struct
+{
+	uint8_t magic;
+	uint16_t clock; // packed HHMM (clock_pack)
+	uint8_t weekday;
+	uint16_t alarmTimes[ALARM_COUNT];
+	uint8_t alarmDays[ALARM_COUNT];
+	uint8_t checksum;
+};
+/* Hold-up the supply must give, a datasheet estimate (tWD_EEPROM 3.3ms,
+ * 3.4ms per write) and NOT a measurement: a main-context byte write in
+ * progress (eeprom_store), then every byte of the record and of the
+ * longest save time changed, 47.6ms with ALARM_COUNT 2. The measured
+ * worst case asked for has not been taken; the E page of user_ramStats
+ * shows the longest record save seen on the board it runs on. */
+#define POWERFAIL_WORST_MS ((1 + sizeof(struct powerfail_struct) + sizeof(uint16_t)) * 34 / 10)
+
+/* Uncomment for the IR loopback self-test build (irtx.h): an IR LED on
+ * PD3 sends NEC frames to the receiver. At cold start the time entry is
+ * driven with LOOPBACK_ROUNDS rounds of the LOOPBACK keys, then the key
+ * to display latencies are shown (user_irLoopback). Needs Timer2 and PD3,
+ * not with RTC_DS3231 or a Timer2 display backend. */
+//#define IR_LOOPBACK
+#define LOOPBACK_ROUNDS 16	 // frames per key
+#define LOOPBACK_PERIOD_MS 300 // frame to frame, over KEY_REPEAT_MS plus a frame
+
+/* General definitions */
+#define HIGH(x) (((x) >> 8) & 0xFF)
+#define LOW(x) ((x)&0xFF)
+
+/* Functions declarations */
+void timer1_init(void);
+void clock_start(uint8_t restart);
+uint32_t timer1_now(void);
+void clock_minuteTick(void);
+void user_mode(uint8_t command);
+void user_idle(void);
+void display_resume(void);
+void clock_set(const volatile int8_t *digits, uint8_t weekday);
+void timeEntry_start(uint8_t commit);
+void timeEntry_poll(void);
+void clockControl_incDigit(void);
+void clockControl_decDigit(void);
+void clockControl_incDigitNum(void);
+void clockControl_decDigitNum(void);
+uint8_t time_enterDigit(volatile int8_t *digits, volatile uint8_t *ptr, uint8_t value);
+void clockUpdateDisplay(void);
+void clock_getSnapshot(struct clock_snapshot *snap);
+void user_setAlarm(void);
+uint8_t user_setAlarmDays(uint8_t days);
+uint8_t user_pickValue(uint8_t symbol, uint8_t value, uint8_t min, uint8_t max);
+void alarm_schedule(uint8_t inclusive);
+void user_stopwatch(uint8_t countdown);
+void stopwatchUpdateDisplay(uint32_t ticks);
+void stopwatch_refresh(void);
+void alarmControl_incDigit(void);
+void alarmControl_decDigit(void);
+void alarmControl_incDigitNum(void);
+void alarmControl_decDigitNum(void);
+void alarmBuzzer_activate(void);
+void alarmBuzzer_off(void);
+void remote_loadFilter(void);
+void user_learnRemote(void);
+void user_learnKeys(void);
+void user_ramStats(void);
+void user_irDump(void);
+void resume_save(void);
+uint8_t resume_restore(void);
+void powerfail_init(void);
+void powerfail_arm(void);
+uint8_t eeprom_lock(void);
+void eeprom_unlock(uint8_t lock);
+void eeprom_store(void *dst, const void *src, uint8_t size);
+void powerfail_restore(void);
+uint16_t powerfail_maxMs(void);
+void user_irLoopback(void);
+void loopback_step(void);
+struct ds3231_time;
+void rtc_sync(uint8_t status, const struct ds3231_time *time);
+uint8_t rtc_load(void);
+void rtc_store(void);
+
 #endif
\ No newline at end of file
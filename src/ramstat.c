@@ -0,0 +1,56 @@
+/*
+ * ramstat.c
+ *
+ * RAM high-water marks. At boot the RAM between the statics and the
+ * stack is painted with RAMSTAT_PAINT, the deepest stack use is where
+ * the paint got overwritten. There is no heap (no malloc), so what is
+ * still painted is the real headroom left for the stack.
+ *
+ * ISR nesting is counted by RAMSTAT_ISR_ENTER/EXIT in every ISR. All
+ * ISRs run with interrupts disabled, so anything above 1 means an ISR
+ * was made interruptible.
+ */
+#include <avr/io.h>
+#include "ramstat.h"
+
+#ifdef RAMSTAT_ENABLE
+
+// Linker symbols: start of .data and end of the statics
+extern uint8_t __data_start;
+extern uint8_t __heap_start;
+
+/*
+ * Function: ramstat_paint
+ * -----------------------
+ * Runs before main (.init3) while the stack is still empty: paints
+ * everything from the end of the statics up to RAMEND.
+ */
+void ramstat_paint(void) __attribute__((naked)) __attribute__((used)) __attribute__((section(".init3")));
+void ramstat_paint(void)
+{
+	uint8_t *p = &__heap_start;
+	while (p <= (uint8_t *)RAMEND)
+		*p++ = RAMSTAT_PAINT;
+}
+
+/*
+ * Function: ramstat_get
+ * ---------------------
+ * Measures the RAM use. Scans the painted area, about 10 cycles per
+ * free byte, so better not call it from time critical code.
+ *
+ * stat: where the results are stored
+ */
+void ramstat_get(struct ramstat *stat)
+{
+	const uint8_t *p = &__heap_start;
+	while ((p <= (const uint8_t *)RAMEND) && (*p == RAMSTAT_PAINT))
+		p++;
+	stat->staticSize = &__heap_start - &__data_start;
+	stat->headroom = p - &__heap_start;
+	stat->stackPeak = (const uint8_t *)RAMEND + 1 - p;
+	stat->isrNestMax = RAMSTAT_NEST_MAX;
+	return;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef RAMSTAT_H
+#define RAMSTAT_H
+
+#include <inttypes.h>
+#include <avr/io.h>
+
+// Comment this out to drop the stack painting and ISR counters
+#define RAMSTAT_ENABLE
+
+// Byte the free RAM is painted with at boot
+#define RAMSTAT_PAINT 0xC5
+
+// ISR nesting, kept in GPIORs so enter/exit compile to in/inc/out
+#define RAMSTAT_NEST GPIOR1		// current depth
+#define RAMSTAT_NEST_MAX GPIOR2 // deepest seen
+
+struct ramstat
+{
+	uint16_t staticSize; // .data, .bss and .noinit
+	uint16_t stackPeak;	 // deepest stack use since boot
+	uint16_t headroom;	 // never touched bytes between statics and stack
+	uint8_t isrNestMax;	 // deepest ISR nesting since boot
+};
+
+#ifdef RAMSTAT_ENABLE
+void ramstat_get(struct ramstat *stat);
+// Every ISR starts with RAMSTAT_ISR_ENTER and leaves through RAMSTAT_ISR_EXIT
+#define RAMSTAT_ISR_ENTER()                       \
+	do                                            \
+	{                                             \
+		if (++RAMSTAT_NEST > RAMSTAT_NEST_MAX)    \
+			RAMSTAT_NEST_MAX = RAMSTAT_NEST;      \
+	} while (0)
+#define RAMSTAT_ISR_EXIT() (RAMSTAT_NEST--)
+#else
+#define RAMSTAT_ISR_ENTER()
+#define RAMSTAT_ISR_EXIT()
+#endif
+
+#endif
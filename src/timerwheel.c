@@ -0,0 +1,209 @@
+/*
+ * timerwheel.c
+ *
+ * Software timers on the Timer1 timebase: one-shot and periodic
+ * callbacks in a hashed timer wheel of TW_SLOTS lists.
+ *
+ * Timer1 compare B ticks the wheel at TW_TICK_HZ and only while a timer
+ * is running, so the timebase stays tickless when nothing is pending.
+ * The ISR just counts the tick, expired timers are run by tw_poll from
+ * the main loop or a user interface loop. Starting or stopping a timer
+ * is O(1), each tick walks a single slot.
+ *
+ * Timers are owned by the caller (no allocation). All functions except
+ * the ISR must be called from main context, callbacks may start and stop
+ * any timer but must not call tw_poll.
+ */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "main.h"
+#include "timerwheel.h"
+#include "ramstat.h"
+
+_Static_assert((TW_SLOTS & (TW_SLOTS - 1)) == 0, "TW_SLOTS must be a power of two");
+
+static struct tw_timer *tw_wheel[TW_SLOTS];
+static uint8_t tw_cursor;			 // slot of the last processed tick
+static uint8_t tw_count;			 // running timers
+static volatile uint8_t tw_pending;	 // ticks counted by the ISR, not yet processed
+static volatile uint8_t tw_frac;	 // fractional Timer1 ticks of the wheel tick
+
+/*
+ * Interrupt Service Routine, TIMER1_COMPB_vect
+ * --------------------------------------------
+ * Wheel tick. The period is TIMER1_HZ / TW_TICK_HZ ticks, the remainder
+ * is spread over the periods (156 or 157 ticks for 10ms at 16MHz).
+ */
+ISR(TIMER1_COMPB_vect)
+{
+	RAMSTAT_ISR_ENTER();
+	uint16_t step = TIMER1_HZ / TW_TICK_HZ;
+	tw_frac += TIMER1_HZ % TW_TICK_HZ;
+	if (tw_frac >= TW_TICK_HZ)
+	{
+		tw_frac -= TW_TICK_HZ;
+		step++;
+	}
+	OCR1B += step;
+	tw_pending++;
+	RAMSTAT_ISR_EXIT();
+}
+
+/*
+ * Function: tw_link
+ * -----------------
+ * Pushes a timer at the head of a list
+ */
+static void tw_link(struct tw_timer **head, struct tw_timer *timer)
+{
+	timer->next = *head;
+	if (timer->next)
+		timer->next->pprev = &timer->next;
+	*head = timer;
+	timer->pprev = head;
+	return;
+}
+
+/*
+ * Function: tw_unlink
+ * -------------------
+ * Removes a timer from the list it is in
+ */
+static void tw_unlink(struct tw_timer *timer)
+{
+	*timer->pprev = timer->next;
+	if (timer->next)
+		timer->next->pprev = timer->pprev;
+	timer->pprev = 0;
+	return;
+}
+
+/*
+ * Function: tw_insert
+ * -------------------
+ * Puts a timer in the slot delay ticks ahead of the cursor. The slot is
+ * passed (delay - 1) / TW_SLOTS times before the timer is due.
+ */
+static void tw_insert(struct tw_timer *timer, uint16_t delay)
+{
+	if (delay == 0)
+		delay = 1;
+	timer->rounds = (delay - 1) / TW_SLOTS;
+	tw_link(&tw_wheel[(tw_cursor + delay) & (TW_SLOTS - 1)], timer);
+	return;
+}
+
+/*
+ * Function: tw_tickEnable
+ * -----------------------
+ * Starts or stops the wheel tick (Timer1 compare B)
+ */
+static void tw_tickEnable(uint8_t enable)
+{
+	uint8_t sreg = SREG;
+	cli();
+	if (enable)
+	{
+		OCR1B = TCNT1 + TIMER1_HZ / TW_TICK_HZ;
+		TIFR1 = (1 << OCF1B);
+		TIMSK1 |= (1 << OCIE1B);
+	}
+	else
+	{
+		TIMSK1 &= ~(1 << OCIE1B);
+	}
+	tw_pending = 0;
+	SREG = sreg;
+	return;
+}
+
+/*
+ * Function: tw_start
+ * ------------------
+ * (Re)starts a timer, a running timer is rescheduled.
+ *
+ * timer: caller owned timer, zero initialized before first use
+ * delay: wheel ticks till the first expiry (see TW_MS), the tick in
+ *        progress counts as one
+ * period: wheel ticks between further expiries, 0 for one-shot
+ * callback: run from tw_poll on expiry, may be 0
+ */
+void tw_start(struct tw_timer *timer, uint16_t delay, uint16_t period, tw_callback_t callback)
+{
+	if (tw_isActive(timer))
+		tw_unlink(timer);
+	else if (tw_count++ == 0)
+		tw_tickEnable(1);
+	timer->callback = callback;
+	timer->period = period;
+	tw_insert(timer, delay);
+	return;
+}
+
+/*
+ * Function: tw_stop
+ * -----------------
+ * Stops a timer, stopping a stopped timer does nothing
+ */
+void tw_stop(struct tw_timer *timer)
+{
+	if (!tw_isActive(timer))
+		return;
+	tw_unlink(timer);
+	tw_count--;
+	return;
+}
+
+/*
+ * Function: tw_isDue
+ * ------------------
+ * returns 1 if ticks are waiting for tw_poll
+ */
+uint8_t tw_isDue(void)
+{
+	return tw_pending != 0;
+}
+
+/*
+ * Function: tw_poll
+ * -----------------
+ * Advances the wheel by the ticks counted since the last call and runs
+ * the callbacks of the expired timers. Periodic timers are rescheduled
+ * before their callback runs. Stops the tick when no timer is left.
+ */
+void tw_poll(void)
+{
+	struct tw_timer *due, *timer;
+	while (tw_pending)
+	{
+		cli();
+		tw_pending--;
+		sei();
+		tw_cursor = (tw_cursor + 1) & (TW_SLOTS - 1);
+
+		/* Detach the slot, so callbacks can safely touch any timer */
+		due = tw_wheel[tw_cursor];
+		tw_wheel[tw_cursor] = 0;
+		if (due)
+			due->pprev = &due;
+		while ((timer = due) != 0)
+		{
+			tw_unlink(timer);
+			if (timer->rounds)
+			{
+				timer->rounds--;
+				tw_link(&tw_wheel[tw_cursor], timer);
+				continue;
+			}
+			if (timer->period)
+				tw_insert(timer, timer->period);
+			else
+				tw_count--;
+			if (timer->callback)
+				timer->callback();
+		}
+	}
+	if ((tw_count == 0) && (TIMSK1 & (1 << OCIE1B)))
+		tw_tickEnable(0);
+	return;
+}
@@ -0,0 +1,32 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <inttypes.h>
+
+// Wheel tick rate, paced by Timer1 compare B
+#define TW_TICK_HZ 100
+
+// Slots in the wheel (power of two), longer delays count full turns
+#define TW_SLOTS 32
+
+// Milliseconds to wheel ticks, rounded up
+#define TW_MS(ms) ((uint16_t)(((uint32_t)(ms)*TW_TICK_HZ + 999) / 1000))
+
+typedef void (*tw_callback_t)(void);
+
+struct tw_timer
+{
+	struct tw_timer *next;
+	struct tw_timer **pprev; // link pointing at this timer, 0 = stopped
+	tw_callback_t callback;	 // may be 0, then only tw_isActive is of use
+	uint16_t period;		 // wheel ticks, 0 = one-shot
+	uint16_t rounds;		 // full wheel turns left
+};
+
+void tw_start(struct tw_timer *timer, uint16_t delay, uint16_t period, tw_callback_t callback);
+void tw_stop(struct tw_timer *timer);
+void tw_poll(void);
+uint8_t tw_isDue(void);
+#define tw_isActive(timer) ((timer)->pprev != 0)
+
+#endif
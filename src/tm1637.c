@@ -0,0 +1,266 @@
+/*
+ * tm1637.c
+ *
+ * TM1637 display backend. The two wire bus is bit-banged one step per
+ * Timer2 compare interrupt, so a redraw never blocks the caller:
+ * tm1637_setDigit only stores the segments and starts a transfer when the
+ * bus is idle. Digits changed during a transfer are sent again once it
+ * ends. A full frame is three packets (data command, address and
+ * segments, display control), about 18 steps per byte.
+ *
+ * The ACK bit is clocked but not checked, there is nothing to retry with.
+ * A transfer holds full speed (CLKGOV_DISPLAY_BUS): at the idle clock a
+ * step would leave the CPU no time between the interrupts.
+ */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "main.h"
+#include "display.h"
+#include "clockgov.h"
+#include "ramstat.h"
+#include <util/delay.h>
+
+#if DISPLAY_BACKEND == DISPLAY_TM1637
+
+#define TM1637_CLK_LOW (TM1637_ddr |= (1 << TM1637_CLK))
+#define TM1637_CLK_HIGH (TM1637_ddr &= ~(1 << TM1637_CLK))
+#define TM1637_DIO_LOW (TM1637_ddr |= (1 << TM1637_DIO))
+#define TM1637_DIO_HIGH (TM1637_ddr &= ~(1 << TM1637_DIO))
+
+// Bus steps
+enum tm1637_state
+{
+	TM1637_START,	  // DIO falls while CLK is high
+	TM1637_LOW,		  // CLK low, next data bit (or DIO released for the ACK)
+	TM1637_HIGH,	  // CLK high, bit is read
+	TM1637_STOP,	  // CLK and DIO low
+	TM1637_STOP_HIGH, // CLK high
+	TM1637_STOP_END	  // DIO rises while CLK is high
+};
+
+static uint8_t tm1637_digits;
+static uint8_t tm1637_segments[8];
+static uint8_t tm1637_control = TM1637_CMD_ON | TM1637_BRIGHTNESS;
+static volatile uint8_t tm1637_dirty; // segments changed since the transfer was loaded
+static volatile uint8_t tm1637_busy;  // transfer running
+
+// Transfer, used by the ISR only while busy
+static uint8_t tm1637_tx[3 + 8];
+static uint8_t tm1637_txLen, tm1637_pos, tm1637_bit, tm1637_byte, tm1637_state;
+static uint16_t tm1637_ends; // bit 0 set: packet ends with the current byte
+
+/*
+ * Function: tm1637_load
+ * ---------------------
+ * Loads the next transfer, the bus must be idle
+ *
+ * full: 1 for the whole frame, 0 for the display control packet only
+ */
+static void tm1637_load(uint8_t full)
+{
+	uint8_t i = 0, n = tm1637_digits;
+	if (full)
+	{
+		tm1637_dirty = 0;
+		tm1637_tx[i++] = TM1637_CMD_DATA;
+		tm1637_tx[i++] = TM1637_CMD_ADDRESS;
+		for (uint8_t j = 0; j < n; j++)
+			tm1637_tx[i++] = tm1637_segments[j];
+		tm1637_ends = (1 << 0) | (1 << (n + 1)) | (1 << (n + 2));
+	}
+	else
+		tm1637_ends = 1;
+	tm1637_tx[i++] = tm1637_control;
+	tm1637_txLen = i;
+	tm1637_pos = 0;
+	tm1637_bit = 0;
+	tm1637_state = TM1637_START;
+	return;
+}
+
+/*
+ * Function: tm1637_step
+ * ---------------------
+ * Does one bus step of the loaded transfer
+ *
+ * returns 0 when the transfer is done
+ */
+static uint8_t tm1637_step(void)
+{
+	switch (tm1637_state)
+	{
+	case TM1637_START:
+		TM1637_DIO_LOW;
+		tm1637_state = TM1637_LOW;
+		break;
+	case TM1637_LOW:
+		TM1637_CLK_LOW;
+		if (tm1637_bit == 0)
+			tm1637_byte = tm1637_tx[tm1637_pos];
+		if ((tm1637_bit == 8) || (tm1637_byte & 1)) // LSB first
+			TM1637_DIO_HIGH;
+		else
+			TM1637_DIO_LOW;
+		tm1637_byte >>= 1;
+		tm1637_state = TM1637_HIGH;
+		break;
+	case TM1637_HIGH:
+		TM1637_CLK_HIGH;
+		tm1637_state = TM1637_LOW;
+		if (++tm1637_bit > 8) // ACK clocked
+		{
+			tm1637_bit = 0;
+			tm1637_pos++;
+			if (tm1637_ends & 1)
+				tm1637_state = TM1637_STOP;
+			tm1637_ends >>= 1;
+		}
+		break;
+	case TM1637_STOP:
+		TM1637_CLK_LOW;
+		TM1637_DIO_LOW;
+		tm1637_state = TM1637_STOP_HIGH;
+		break;
+	case TM1637_STOP_HIGH:
+		TM1637_CLK_HIGH;
+		tm1637_state = TM1637_STOP_END;
+		break;
+	default: // TM1637_STOP_END
+		TM1637_DIO_HIGH;
+		tm1637_state = TM1637_START;
+		if (tm1637_pos == tm1637_txLen)
+			return 0;
+		break;
+	}
+	return 1;
+}
+
+/*
+ * Function: tm1637_kick
+ * ---------------------
+ * Starts a full frame if the bus is idle, else the running transfer
+ * picks up the change when it ends (tm1637_dirty)
+ */
+static void tm1637_kick(void)
+{
+	uint8_t sreg = SREG;
+	cli();
+	if (!tm1637_busy)
+	{
+		tm1637_busy = 1;
+		clkgov_request(CLKGOV_DISPLAY_BUS);
+		tm1637_load(1);
+		TCNT2 = 0;
+		TIFR2 = (1 << OCF2A);
+		TIMSK2 |= (1 << OCIE2A);
+	}
+	SREG = sreg;
+	return;
+}
+
+/*
+ * Interrupt Service Routine, TIMER2_COMPA_vect
+ * --------------------------------------------
+ * One bus step, every TM1637_STEP_US while a transfer runs
+ */
+ISR(TIMER2_COMPA_vect)
+{
+	RAMSTAT_ISR_ENTER();
+	if (!tm1637_step())
+	{
+		if (tm1637_dirty)
+			tm1637_load(1);
+		else
+		{
+			TIMSK2 &= ~(1 << OCIE2A);
+			tm1637_busy = 0;
+			clkgov_release(CLKGOV_DISPLAY_BUS);
+		}
+	}
+	RAMSTAT_ISR_EXIT();
+}
+
+/*
+ * Function: tm1637_init
+ * ---------------------
+ * Sets up the pins and Timer2, the first frame is sent by the first
+ * tm1637_setDigit
+ *
+ * digits: number of digits (1-8)
+ */
+void tm1637_init(uint8_t digits)
+{
+	tm1637_digits = digits;
+	TM1637_port &= ~((1 << TM1637_CLK) | (1 << TM1637_DIO));
+	TM1637_ddr &= ~((1 << TM1637_CLK) | (1 << TM1637_DIO)); // both released
+	TCCR2A = (1 << WGM21); // CTC
+	OCR2A = TM1637_STEP_TICKS - 1;
+	TCCR2B = DISPLAY_T2_CS_FULL;
+	return;
+}
+
+/*
+ * Function: tm1637_setDigit
+ * -------------------------
+ * Sets a digit, sent in the background
+ *
+ * digit: 1 (leftmost) to the number of digits
+ * code: code B character, bit 7 = decimal point
+ */
+void tm1637_setDigit(uint8_t digit, uint8_t code)
+{
+	if ((digit == 0) || (digit > tm1637_digits))
+		return; // error
+	tm1637_segments[digit - 1] = display_segments(code);
+	tm1637_dirty = 1;
+	tm1637_kick();
+	return;
+}
+
+/*
+ * Function: tm1637_shutdown
+ * -------------------------
+ * Turns the display off or on, sent in the background
+ *
+ * shutdownFlag: if set to 1, the display is off, else is in normal mode
+ */
+void tm1637_shutdown(uint8_t shutdownFlag)
+{
+	tm1637_control = shutdownFlag ? TM1637_CMD_OFF : (TM1637_CMD_ON | TM1637_BRIGHTNESS);
+	tm1637_dirty = 1;
+	tm1637_kick();
+	return;
+}
+
+/*
+ * Function: tm1637_shutdownISR
+ * ----------------------------
+ * tm1637_shutdown for interrupt handlers: drops the transfer in flight
+ * and sends the display control packet at once, about 22 steps. On
+ * power up the whole frame is sent again in the background.
+ *
+ * shutdownFlag: if set to 1, the display is off, else is in normal mode
+ */
+void tm1637_shutdownISR(uint8_t shutdownFlag)
+{
+	TIMSK2 &= ~(1 << OCIE2A);
+	TM1637_ddr &= ~((1 << TM1637_CLK) | (1 << TM1637_DIO)); // idle bus, the start resyncs the chip
+	if (tm1637_busy)
+	{
+		tm1637_busy = 0;
+		clkgov_release(CLKGOV_DISPLAY_BUS); // the caller runs at full speed
+	}
+	tm1637_control = shutdownFlag ? TM1637_CMD_OFF : (TM1637_CMD_ON | TM1637_BRIGHTNESS);
+	tm1637_load(0);
+	do
+		_delay_us(TM1637_STEP_US);
+	while (tm1637_step());
+	if (!shutdownFlag)
+	{
+		tm1637_dirty = 1;
+		tm1637_kick();
+	}
+	return;
+}
+
+#endif
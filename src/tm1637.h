@@ -0,0 +1,34 @@
+#ifndef TM1637_H
+#define TM1637_H
+
+#ifndef F_CPU
+#define F_CPU 16000000UL // 16MHz clock
+#endif
+
+#include <inttypes.h>
+
+/*
+ * Pins, open drain: the port bits stay 0, a line is pulled low by making
+ * it an output and released by making it an input (module pull-ups).
+ */
+#define TM1637_ddr DDRB
+#define TM1637_port PORTB
+#define TM1637_CLK PORTB5
+#define TM1637_DIO PORTB3
+
+#define TM1637_BRIGHTNESS 5	 // 0-7
+#define TM1637_STEP_TICKS 2	 // Timer2 ticks (8us) per bus step, 2 steps per bit
+#define TM1637_STEP_US (TM1637_STEP_TICKS * 8)
+
+// Commands
+#define TM1637_CMD_DATA 0x40	// write, auto increment
+#define TM1637_CMD_ADDRESS 0xC0 // first digit
+#define TM1637_CMD_ON 0x88		// display on, | brightness
+#define TM1637_CMD_OFF 0x80
+
+void tm1637_init(uint8_t digits);
+void tm1637_setDigit(uint8_t digit, uint8_t code);
+void tm1637_shutdown(uint8_t shutdownFlag);
+void tm1637_shutdownISR(uint8_t shutdownFlag);
+
+#endif
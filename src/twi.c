@@ -0,0 +1,175 @@
+/*
+ * twi.c
+ *
+ * Interrupt driven TWI (I2C) master. twi_transfer only starts the
+ * transfer, the ISR walks it: write tx bytes, then a repeated start and
+ * read rx bytes, then stop and call back. Either part may be empty.
+ * One transfer at a time, buffers must stay valid until the callback.
+ * There is no timeout of its own, the user calls twi_abort when a
+ * transfer takes too long.
+ */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/twi.h>
+#include "main.h"
+#include "twi.h"
+#include "clockgov.h"
+#include "ramstat.h"
+
+#define TWI_TWBR ((F_CPU / TWI_HZ - 16) / 2) // prescaler 1
+_Static_assert(TWI_TWBR >= 10 && TWI_TWBR <= 255, "TWI_HZ out of reach at F_CPU");
+
+// TWCR values: clear TWINT (go on) with the interrupt kept enabled
+#define TWI_GO ((1 << TWINT) | (1 << TWEN) | (1 << TWIE))
+#define TWI_START (TWI_GO | (1 << TWSTA))
+#define TWI_ACK (TWI_GO | (1 << TWEA))
+#define TWI_STOP ((1 << TWINT) | (1 << TWEN) | (1 << TWSTO))
+
+static uint8_t twi_sla;
+static const uint8_t *twi_tx;
+static uint8_t twi_txLen;
+static uint8_t *twi_rx;
+static uint8_t twi_rxLen;
+static twi_callback_t twi_done;
+static volatile uint8_t twi_busy;
+
+/*
+ * Function: twi_init
+ * ------------------
+ * Sets the bit rate, SDA/SCL need external pull-ups
+ */
+void twi_init(void)
+{
+	TWSR = 0;
+	TWBR = TWI_TWBR;
+	TWCR = (1 << TWEN);
+	return;
+}
+
+/*
+ * Function: twi_transfer
+ * ----------------------
+ * Starts a write then read transfer, returns at once
+ *
+ * address: 7 bit device address
+ * tx, txLen: bytes to write (register address first), txLen may be 0
+ * rx, rxLen: where to read to, rxLen may be 0
+ * done: called from the ISR with enum twi_status, may be 0
+ * returns 0 if a transfer is still running or both lengths are 0
+ */
+uint8_t twi_transfer(uint8_t address, const uint8_t *tx, uint8_t txLen, uint8_t *rx, uint8_t rxLen, twi_callback_t done)
+{
+	if (twi_busy || (txLen == 0 && rxLen == 0))
+		return 0;
+	twi_busy = 1;
+	clkgov_request(CLKGOV_TWI); // TWBR is set for full speed
+	twi_sla = address << 1;
+	twi_tx = tx;
+	twi_txLen = txLen;
+	twi_rx = rx;
+	twi_rxLen = rxLen;
+	twi_done = done;
+	TWCR = TWI_START;
+	return 1;
+}
+
+/*
+ * Function: twi_isBusy
+ * --------------------
+ * returns 1 while a transfer is running
+ */
+uint8_t twi_isBusy(void)
+{
+	return twi_busy;
+}
+
+/*
+ * Function: twi_abort
+ * -------------------
+ * Gives up the running transfer, e.g. with the bus stuck: the TWI is
+ * switched off and on again (drops SDA/SCL), the driver is freed and the
+ * callback gets TWI_ERROR. Does nothing while idle.
+ */
+void twi_abort(void)
+{
+	uint8_t sreg = SREG;
+	cli();
+	if (twi_busy)
+	{
+		TWCR = 0;
+		TWCR = (1 << TWEN);
+		twi_busy = 0;
+		clkgov_release(CLKGOV_TWI);
+		if (twi_done)
+			twi_done(TWI_ERROR); // as from the ISR, interrupts disabled
+	}
+	SREG = sreg;
+	return;
+}
+
+/*
+ * Function: twi_finish
+ * --------------------
+ * Sends stop, frees the driver and reports. Called from the ISR.
+ */
+static void twi_finish(uint8_t status)
+{
+	TWCR = TWI_STOP;
+	twi_busy = 0;
+	clkgov_release(CLKGOV_TWI);
+	if (twi_done)
+		twi_done(status);
+	return;
+}
+
+/*
+ * Interrupt Service Routine, TWI_vect
+ * -----------------------------------
+ * One bus event per call, see the status codes in util/twi.h
+ */
+ISR(TWI_vect)
+{
+	RAMSTAT_ISR_ENTER();
+	switch (TW_STATUS)
+	{
+	case TW_START:
+	case TW_REP_START:
+		TWDR = twi_sla | (twi_txLen ? TW_WRITE : TW_READ);
+		TWCR = TWI_GO;
+		break;
+	case TW_MT_SLA_ACK:
+	case TW_MT_DATA_ACK:
+		if (twi_txLen)
+		{
+			TWDR = *twi_tx++;
+			twi_txLen--;
+			TWCR = TWI_GO;
+		}
+		else if (twi_rxLen)
+			TWCR = TWI_START; // repeated start for the read
+		else
+			twi_finish(TWI_OK);
+		break;
+	case TW_MR_DATA_ACK:
+		*twi_rx++ = TWDR;
+		twi_rxLen--;
+		/* fall through */
+	case TW_MR_SLA_ACK:
+		TWCR = (twi_rxLen > 1) ? TWI_ACK : TWI_GO; // NACK the last byte
+		break;
+	case TW_MR_DATA_NACK:
+		*twi_rx = TWDR;
+		twi_rxLen = 0;
+		twi_finish(TWI_OK);
+		break;
+	case TW_MT_SLA_NACK:
+	case TW_MR_SLA_NACK:
+	case TW_MT_DATA_NACK:
+		twi_finish(TWI_NACK);
+		break;
+	default: // bus error, arbitration lost
+		twi_finish(TWI_ERROR);
+		break;
+	}
+	RAMSTAT_ISR_EXIT();
+}
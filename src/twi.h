@@ -0,0 +1,25 @@
+#ifndef TWI_H
+#define TWI_H
+
+#include <inttypes.h>
+
+// SCL at full speed, the clock governor is held at full speed while busy
+#define TWI_HZ 100000UL
+
+// Result passed to the completion callback
+enum twi_status
+{
+	TWI_OK,
+	TWI_NACK,  // no device at the address, or data refused
+	TWI_ERROR, // bus error or arbitration lost
+};
+
+// Called from the TWI ISR when a transfer ended
+typedef void (*twi_callback_t)(uint8_t status);
+
+void twi_init(void);
+uint8_t twi_transfer(uint8_t address, const uint8_t *tx, uint8_t txLen, uint8_t *rx, uint8_t rxLen, twi_callback_t done);
+uint8_t twi_isBusy(void);
+void twi_abort(void);
+
+#endif
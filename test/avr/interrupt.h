@@ -0,0 +1,13 @@
+/*
+ * Host shim: an ISR is a plain function the simulated bus calls
+ */
+#ifndef SHIM_AVR_INTERRUPT_H
+#define SHIM_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define ISR(vector) void vector(void)
+#define cli() (SREG &= ~(1 << SREG_I))
+#define sei() (SREG |= (1 << SREG_I))
+
+#endif
@@ -0,0 +1,30 @@
+/*
+ * Host shim: the registers used by twi.c and ds3231.c as plain variables,
+ * defined in test_ds3231.c
+ */
+#ifndef SHIM_AVR_IO_H
+#define SHIM_AVR_IO_H
+
+#include <inttypes.h>
+
+extern uint8_t SREG, GPIOR1, GPIOR2;
+extern uint8_t TWCR, TWSR, TWDR, TWBR;
+extern uint8_t DDRD, PORTD, EICRA;
+
+// SREG
+#define SREG_I 7
+
+// TWCR
+#define TWINT 7
+#define TWEA 6
+#define TWSTA 5
+#define TWSTO 4
+#define TWWC 3
+#define TWEN 2
+#define TWIE 0
+
+#define PORTD3 3
+#define ISC11 3
+#define ISC10 2
+
+#endif
@@ -0,0 +1,433 @@
+/*
+ * test_ds3231.c
+ *
+ * Host test of twi.c and ds3231.c. A simulated DS3231 answers the TWI
+ * commands the driver writes to TWCR: it sets TWSR (and TWDR on reads)
+ * like the hardware would and calls TWI_vect, until the driver sends a
+ * stop. Faults (absent device, refused byte, bus error, stuck bus) are
+ * injected per test.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <avr/io.h>
+#include <util/twi.h>
+#include "twi.h"
+#include "ds3231.h"
+#include "clockgov.h"
+
+uint8_t SREG = (1 << SREG_I), GPIOR1, GPIOR2;
+uint8_t TWCR, TWSR, TWDR, TWBR;
+uint8_t DDRD, PORTD, EICRA;
+
+void TWI_vect(void);
+
+static int failures;
+#define CHECK(cond)                                               \
+	do                                                            \
+	{                                                             \
+		if (!(cond))                                              \
+		{                                                         \
+			printf("%s:%d: failed: %s\n", __FILE__, __LINE__, #cond); \
+			failures++;                                           \
+		}                                                         \
+	} while (0)
+
+/* Clock governor stand-in, keeps the requested sources */
+static uint16_t clkgov;
+
+void clkgov_request(uint16_t source)
+{
+	clkgov |= source;
+	return;
+}
+
+void clkgov_release(uint16_t source)
+{
+	clkgov &= ~source;
+	return;
+}
+
+/* Simulated DS3231: registers 0x00-0x12 and the bus state */
+#define SIM_REGS 0x13
+enum sim_phase
+{
+	SIM_SLA,	   // next byte is the address
+	SIM_WRITE_PTR, // next byte is the register pointer
+	SIM_WRITE,	   // next bytes are written from the pointer on
+	SIM_READ,	   // bytes are read from the pointer on
+};
+
+static struct
+{
+	uint8_t regs[SIM_REGS];
+	uint8_t ptr;
+	uint8_t phase;
+	uint8_t owned;	   // start sent, no stop yet
+	uint8_t absent;	   // fault: nobody answers the address
+	int nackByte;	   // fault: written byte (pointer is 0) refused, -1 none
+	int busErrorStep;  // fault: bus error reported at this step, -1 none
+	int step;		   // bus events so far
+	int written;	   // bytes written after the address
+	int stops;
+	uint8_t seen[64];  // TWSR of every event, in order
+} sim;
+
+/* Driver result of the last ds3231 transfer */
+static int doneCount;
+static uint8_t doneStatus;
+static struct ds3231_time doneTime;
+
+static void done(uint8_t status, const struct ds3231_time *time)
+{
+	doneCount++;
+	doneStatus = status;
+	doneTime = *time;
+	return;
+}
+
+/*
+ * Function: sim_reset
+ * -------------------
+ * Idle bus, no faults, driver freed
+ */
+static void sim_reset(void)
+{
+	twi_abort();
+	memset(&sim, 0, sizeof(sim));
+	sim.nackByte = -1;
+	sim.busErrorStep = -1;
+	doneCount = 0;
+	doneStatus = 0xFF;
+	memset(&doneTime, 0, sizeof(doneTime));
+	return;
+}
+
+/*
+ * Function: sim_run
+ * -----------------
+ * Carries out the commands the driver leaves in TWCR until a stop, or
+ * until the driver stops asking (TWINT not written)
+ */
+static void sim_run(void)
+{
+	uint8_t cmd, status, sla;
+	while ((cmd = TWCR) & (1 << TWINT))
+	{
+		TWCR = cmd & ~((1 << TWINT) | (1 << TWSTO));
+		CHECK(cmd & (1 << TWEN));
+		if (cmd & (1 << TWSTO))
+		{
+			sim.owned = 0;
+			sim.stops++;
+			return; // no interrupt after a stop
+		}
+		CHECK(cmd & (1 << TWIE));
+		CHECK(sim.step < (int)sizeof(sim.seen));
+		if (sim.step >= (int)sizeof(sim.seen))
+			return;
+
+		if (sim.step == sim.busErrorStep)
+		{
+			status = TW_BUS_ERROR;
+		}
+		else if (cmd & (1 << TWSTA))
+		{
+			status = sim.owned ? TW_REP_START : TW_START;
+			sim.owned = 1;
+			sim.phase = SIM_SLA;
+		}
+		else if (sim.phase == SIM_SLA)
+		{
+			sla = TWDR;
+			if (sim.absent || ((sla >> 1) != DS3231_ADDRESS))
+				status = (sla & TW_READ) ? TW_MR_SLA_NACK : TW_MT_SLA_NACK;
+			else if (sla & TW_READ)
+			{
+				sim.phase = SIM_READ;
+				status = TW_MR_SLA_ACK;
+			}
+			else
+			{
+				sim.phase = SIM_WRITE_PTR;
+				sim.written = 0;
+				status = TW_MT_SLA_ACK;
+			}
+		}
+		else if (sim.phase == SIM_READ)
+		{
+			TWDR = sim.regs[sim.ptr];
+			sim.ptr = (sim.ptr + 1) % SIM_REGS;
+			status = (cmd & (1 << TWEA)) ? TW_MR_DATA_ACK : TW_MR_DATA_NACK;
+		}
+		else if (sim.written++ == sim.nackByte)
+		{
+			status = TW_MT_DATA_NACK;
+		}
+		else
+		{
+			if (sim.phase == SIM_WRITE_PTR)
+			{
+				sim.ptr = TWDR;
+				sim.phase = SIM_WRITE;
+			}
+			else
+			{
+				sim.regs[sim.ptr] = TWDR;
+				sim.ptr = (sim.ptr + 1) % SIM_REGS;
+			}
+			status = TW_MT_DATA_ACK;
+		}
+
+		sim.seen[sim.step++] = status;
+		TWSR = status;
+		TWCR |= (1 << TWINT);
+		TWI_vect();
+	}
+	return;
+}
+
+/*
+ * Function: check_idle
+ * --------------------
+ * Driver freed and governor released, as after every transfer
+ */
+static void check_idle(void)
+{
+	CHECK(!twi_isBusy());
+	CHECK(!(clkgov & CLKGOV_TWI));
+	return;
+}
+
+static void test_decode(void)
+{
+	static const struct
+	{
+		uint8_t hours;
+		uint8_t expect;
+	} table[] = {
+		{0x00, 0}, {0x09, 9}, {0x23, 23},  // 24h
+		{0x52, 0}, {0x41, 1}, {0x51, 11},  // 12h AM, 12 AM is 0
+		{0x72, 12}, {0x61, 13}, {0x71, 23}, // 12h PM, 12 PM is 12
+	};
+	uint8_t regs[4];
+	struct ds3231_time time;
+	for (unsigned i = 0; i < sizeof(table) / sizeof(table[0]); i++)
+	{
+		regs[0] = 0x59;
+		regs[1] = 0x07;
+		regs[2] = table[i].hours;
+		regs[3] = 7;
+		ds3231_decode(regs, &time);
+		CHECK(time.hours == table[i].expect);
+		CHECK(time.minutes == 7);
+		CHECK(time.seconds == 59);
+		CHECK(time.weekday == 6);
+	}
+
+	/* Weekday register out of range (0) falls back to day 1 */
+	regs[3] = 0;
+	ds3231_decode(regs, &time);
+	CHECK(time.weekday == 0);
+	return;
+}
+
+static void test_encode(void)
+{
+	uint8_t regs[16];
+	struct ds3231_time time, back;
+	for (uint8_t hours = 0; hours < 24; hours++)
+	{
+		time.seconds = 45;
+		time.minutes = 38;
+		time.hours = hours;
+		time.weekday = hours % 7;
+		memset(regs, 0xAA, sizeof(regs));
+		ds3231_encode(&time, regs);
+		CHECK(!(regs[2] & 0x40)); // 24h mode
+		CHECK(regs[0] == 0x45 && regs[1] == 0x38);
+		CHECK(regs[3] == time.weekday + 1);
+		CHECK(regs[4] == 1 && regs[5] == 1);
+		CHECK(regs[0x0E] == 0); // oscillator on, SQW 1Hz
+		CHECK(regs[0x0F] == 0); // OSF cleared
+		ds3231_decode(regs, &back);
+		CHECK(memcmp(&back, &time, sizeof(time)) == 0);
+	}
+	return;
+}
+
+static void test_read(void)
+{
+	static const uint8_t walk[] = {TW_START, TW_MT_SLA_ACK, TW_MT_DATA_ACK, TW_REP_START, TW_MR_SLA_ACK};
+	sim_reset();
+	sim.regs[0] = 0x30;
+	sim.regs[1] = 0x59;
+	sim.regs[2] = 0x40 | 0x20 | 0x11; // 11 PM
+	sim.regs[3] = 3;
+	sim.ptr = 0x0A; // left elsewhere, the read sets it
+
+	CHECK(ds3231_read(done));
+	CHECK(twi_isBusy());
+	CHECK(clkgov & CLKGOV_TWI);
+	sim_run();
+
+	CHECK(memcmp(sim.seen, walk, sizeof(walk)) == 0);
+	for (int i = sizeof(walk); i < (int)sizeof(walk) + 15; i++)
+		CHECK(sim.seen[i] == TW_MR_DATA_ACK);
+	CHECK(sim.seen[sizeof(walk) + 15] == TW_MR_DATA_NACK); // 16 registers, last one NACKed
+	CHECK(sim.step == sizeof(walk) + 16);
+	CHECK(sim.stops == 1);
+	CHECK(doneCount == 1);
+	CHECK(doneStatus == DS3231_OK);
+	CHECK(doneTime.hours == 23 && doneTime.minutes == 59 && doneTime.seconds == 30);
+	CHECK(doneTime.weekday == 2);
+	check_idle();
+	return;
+}
+
+static void test_readStopped(void)
+{
+	sim_reset();
+	sim.regs[2] = 0x12;
+	sim.regs[3] = 1;
+	sim.regs[0x0F] = 0x80; // OSF
+	CHECK(ds3231_read(done));
+	sim_run();
+	CHECK(doneCount == 1);
+	CHECK(doneStatus == DS3231_STOPPED);
+	check_idle();
+	return;
+}
+
+static void test_write(void)
+{
+	struct ds3231_time time = {9, 5, 7, 2};
+	uint8_t regs[16];
+	sim_reset();
+	memset(sim.regs, 0xAA, sizeof(sim.regs));
+	sim.regs[0x0F] = 0x80; // OSF, cleared by the write
+
+	CHECK(ds3231_write(&time, done));
+	sim_run();
+
+	CHECK(sim.seen[0] == TW_START && sim.seen[1] == TW_MT_SLA_ACK);
+	for (int i = 2; i < 2 + 17; i++)
+		CHECK(sim.seen[i] == TW_MT_DATA_ACK); // pointer and 16 registers
+	CHECK(sim.step == 2 + 17);
+	CHECK(sim.stops == 1);
+	ds3231_encode(&time, regs);
+	CHECK(memcmp(sim.regs, regs, sizeof(regs)) == 0);
+	CHECK(sim.regs[0x10] == 0xAA); // past the registers written
+	CHECK(doneCount == 1);
+	CHECK(doneStatus == DS3231_OK);
+	check_idle();
+	return;
+}
+
+static void test_absent(void)
+{
+	sim_reset();
+	sim.absent = 1;
+	CHECK(ds3231_read(done));
+	sim_run();
+	CHECK(sim.step == 2);
+	CHECK(sim.seen[1] == TW_MT_SLA_NACK);
+	CHECK(sim.stops == 1);
+	CHECK(doneCount == 1);
+	CHECK(doneStatus == DS3231_FAILED);
+	check_idle();
+	return;
+}
+
+static void test_dataNack(void)
+{
+	struct ds3231_time time = {0, 0, 0, 0};
+	sim_reset();
+	sim.nackByte = 3; // third register
+	CHECK(ds3231_write(&time, done));
+	sim_run();
+	CHECK(sim.seen[sim.step - 1] == TW_MT_DATA_NACK);
+	CHECK(sim.step == 2 + 4);
+	CHECK(sim.stops == 1);
+	CHECK(doneCount == 1);
+	CHECK(doneStatus == DS3231_FAILED);
+	check_idle();
+	return;
+}
+
+static void test_busError(void)
+{
+	sim_reset();
+	sim.busErrorStep = 7; // in the middle of the registers read
+	CHECK(ds3231_read(done));
+	sim_run();
+	CHECK(sim.step == 8);
+	CHECK(sim.seen[7] == TW_BUS_ERROR);
+	CHECK(sim.stops == 1);
+	CHECK(doneCount == 1);
+	CHECK(doneStatus == DS3231_FAILED);
+	check_idle();
+	return;
+}
+
+static void test_stuck(void)
+{
+	struct ds3231_time time = {0, 0, 0, 0};
+	uint8_t tx = 0;
+	sim_reset();
+	CHECK(!twi_transfer(DS3231_ADDRESS, &tx, 0, 0, 0, 0)); // nothing to do
+
+	/* Bus never answers: the start is not carried out */
+	CHECK(ds3231_read(done));
+	CHECK(!ds3231_read(done));
+	CHECK(!ds3231_write(&time, done));
+	CHECK(twi_isBusy());
+	CHECK(clkgov & CLKGOV_TWI);
+	CHECK(doneCount == 0);
+
+	ds3231_abort();
+	CHECK(doneCount == 1);
+	CHECK(doneStatus == DS3231_FAILED);
+	CHECK(TWCR == (1 << TWEN));
+	CHECK(SREG & (1 << SREG_I)); // interrupts enabled again
+	check_idle();
+
+	/* Idle: nothing happens */
+	ds3231_abort();
+	CHECK(doneCount == 1);
+
+	/* The driver works again */
+	sim.regs[2] = 0x08;
+	sim.regs[3] = 1;
+	CHECK(ds3231_read(done));
+	sim_run();
+	CHECK(doneCount == 2);
+	CHECK(doneStatus == DS3231_OK);
+	CHECK(doneTime.hours == 8);
+	check_idle();
+	return;
+}
+
+int main(void)
+{
+	ds3231_init();
+	CHECK(TWCR == (1 << TWEN));
+	CHECK(TWBR == (F_CPU / TWI_HZ - 16) / 2);
+
+	test_decode();
+	test_encode();
+	test_read();
+	test_readStopped();
+	test_write();
+	test_absent();
+	test_dataNack();
+	test_busError();
+	test_stuck();
+
+	if (failures)
+	{
+		printf("test_ds3231: %d checks failed\n", failures);
+		return 1;
+	}
+	printf("test_ds3231: ok\n");
+	return 0;
+}